@@ -1,8 +1,10 @@
 #define _GNU_SOURCE
 
 #include <ctype.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,6 +14,11 @@
 ////////////////////////////////////////////////////////////////////////////
 
 extern char *user_input;
+// user_inputは'\0'で終わっているとは限らない
+extern char *user_input_end;
+extern char *input_path;
+// -O1なら1. 最適化のパスを有効にする
+extern int opt_level;
 
 ////////////////////////////////////////////////////////////////////////////
 // util.c
@@ -20,6 +27,121 @@ extern char *user_input;
 void error_at(char *loc, char *fmt, ...);
 void error(char *fmt, ...);
 
+////////////////////////////////////////////////////////////////////////////
+// arena.c
+////////////////////////////////////////////////////////////////////////////
+
+typedef struct ArenaChunk ArenaChunk;
+
+struct ArenaChunk {
+	ArenaChunk *next;
+	size_t cap;
+	size_t used;
+	char data[];
+};
+
+typedef struct Arena Arena;
+
+/**
+ * @brief フェーズごとにまとめて確保・解放するためのメモリ領域
+ * @param name --arena-statsで表示する名前
+ * @param head 現在確保中のチャンク(先頭が最新)
+ * @param used 確保済みのバイト数
+ * @param peak arena_resetをまたいだusedの最大値
+ * @param reserved チャンクとして確保したバイト数
+ *
+ */
+struct Arena {
+	char *name;
+	ArenaChunk *head;
+	size_t used;
+	size_t peak;
+	size_t reserved;
+	int chunk_count;
+};
+
+// Node, ローカル変数. 関数ごとに解放する
+extern Arena node_arena;
+// グローバル変数, Function
+extern Arena global_arena;
+// Type
+extern Arena type_arena;
+// internした識別子の文字列
+extern Arena ident_arena;
+extern bool arena_debug;
+
+void *arena_alloc(Arena *arena, size_t size);
+void arena_free(Arena *arena);
+void arena_reset(Arena *arena);
+void arena_report(void);
+
+////////////////////////////////////////////////////////////////////////////
+// intern.c
+////////////////////////////////////////////////////////////////////////////
+
+int intern(char *name, int len);
+char *intern_name(int id);
+
+////////////////////////////////////////////////////////////////////////////
+// scan.c
+////////////////////////////////////////////////////////////////////////////
+
+typedef enum {
+	SCAN_AUTO,
+	SCAN_SCALAR,
+	SCAN_SSE2,
+	SCAN_AVX2,
+} ScanLevel;
+
+// [p, end)の先頭から続く空白/識別子/数字を読み飛ばし、その直後を返す
+extern char *(*skip_space)(char *p, char *end);
+extern char *(*scan_ident)(char *p, char *end);
+extern char *(*scan_digits)(char *p, char *end);
+
+ScanLevel scan_init(ScanLevel level);
+
+////////////////////////////////////////////////////////////////////////////
+// symtab.c
+////////////////////////////////////////////////////////////////////////////
+
+typedef struct SymSlot SymSlot;
+
+struct SymSlot {
+	// internで得た識別子の番号
+	int id;
+	// NULLなら空きスロット
+	void *val;
+	// 登録されたスコープの深さ
+	int depth;
+};
+
+typedef struct SymTab SymTab;
+
+/**
+ * @brief 識別子の番号をキーにした開番地法のハッシュ表
+ * @param undo 登録の取り消し用の履歴. スコープを抜けるときに巻き戻す
+ * @param marks 各スコープに入ったときのundo_len
+ * 
+ */
+struct SymTab {
+	SymSlot *slots;
+	int cap;
+	int count;
+	SymSlot *undo;
+	int undo_len;
+	int undo_cap;
+	int *marks;
+	int mark_cap;
+	int depth;
+};
+
+void *symtab_find(SymTab *tab, int id);
+void *symtab_find_in_scope(SymTab *tab, int id);
+void symtab_add(SymTab *tab, int id, void *val);
+void symtab_push_scope(SymTab *tab);
+void symtab_pop_scope(SymTab *tab);
+void symtab_clear(SymTab *tab);
+
 ////////////////////////////////////////////////////////////////////////////
 // tokenize.c
 ////////////////////////////////////////////////////////////////////////////
@@ -33,50 +155,95 @@ typedef enum {
 	TK_IDENT,
 	// 数値
 	TK_NUM,
-	// 記号
-	TK_RESERVED,
-	// sizeof
-	TK_SIZEOF,
 	// 終端
 	TK_EOF,
+	// 記号
+	TK_PLUS, // +
+	TK_MINUS, // -
+	TK_STAR, // *
+	TK_SLASH, // /
+	TK_AMP, // &
+	TK_ASSIGN, // =
+	TK_EQ, // ==
+	TK_NE, // !=
+	TK_LT, // <
+	TK_LE, // <=
+	TK_GT, // >
+	TK_GE, // >=
+	TK_LPAREN, // (
+	TK_RPAREN, // )
+	TK_LBRACE, // {
+	TK_RBRACE, // }
+	TK_LBRACKET, // [
+	TK_RBRACKET, // ]
+	TK_SEMI, // ;
+	TK_COMMA, // ,
+	// キーワード
+	TK_RETURN,
+	TK_IF,
+	TK_ELSE,
+	TK_WHILE,
+	TK_FOR,
+	TK_INT,
+	TK_CHAR,
+	TK_SIZEOF,
 } TokenKind;
 
-typedef struct Token Token;
+// トークンのリングバッファの大きさ(2の冪).
+// 今のトークンから TOKEN_RING_SIZE / 2 個前までは番号で参照し直せる
+#define TOKEN_RING_SIZE 1024
+#define TOKEN_RING_MASK (TOKEN_RING_SIZE - 1)
+
+typedef struct TokenArray TokenArray;
 /**
- * @brief トークン情報を管理する
+ * @brief トークン列を管理する. 1トークン分の情報を配列ごとに分けて持つ(13バイト/トークン).
+ * 字句解析はnext()で足りなくなった分だけ行い、トークン番号 i は i & TOKEN_RING_MASK の位置に入る
  * @param kind トークンの種類
- * @param next 次に続くトークンのアドレス
- * @param val 数値だったときの値
- * @param str このトークンの文字列
+ * @param loc このトークンの文字列のuser_inputでの位置
  * @param len このトークンの文字列の長さ
+ * @param val 数値だったときの値、識別子だったときのinternした番号
+ * @param count 字句解析済みのトークンの数
  * 
  */
-struct Token {
-	TokenKind kind;
-	Token *next;
-	int val;
-	char *str;
-	int len;
+struct TokenArray {
+	unsigned char kind[TOKEN_RING_SIZE];
+	int loc[TOKEN_RING_SIZE];
+	int len[TOKEN_RING_SIZE];
+	int val[TOKEN_RING_SIZE];
+	int count;
 };
 
-extern Token *token;
+extern TokenArray tokens;
+// 今見ているトークンの番号
+extern int token;
+
+static inline TokenKind tok_kind(int tok) {
+	return tokens.kind[tok & TOKEN_RING_MASK];
+}
+
+static inline char *tok_str(int tok) {
+	return user_input + tokens.loc[tok & TOKEN_RING_MASK];
+}
 
-Token *tokenize(char *p);
+static inline int tok_len(int tok) {
+	return tokens.len[tok & TOKEN_RING_MASK];
+}
+
+static inline int tok_val(int tok) {
+	return tokens.val[tok & TOKEN_RING_MASK];
+}
+
+static inline int tok_id(int tok) {
+	return tokens.val[tok & TOKEN_RING_MASK];
+}
+
+void tokenize(char *p, char *end);
 void next(void);
-bool consume(char *op);
-bool consume_nxt(char *op);
-bool consume_ident(void);
-Token *consume_ident_nxt(void);
+bool consume(TokenKind kind);
+bool consume_nxt(TokenKind kind);
+int consume_ident_nxt(void);
 bool is_ident(void);
-int consume_cntrl_nxt(void);
-int consume_cntrl(void);
-int get_cntrl_id(void);
-int get_d_type_id(void);
-int consume_d_type_nxt(void);
-int consume_d_type(void);
-int is_cntrl(char *p);
-int is_d_type(char *p);
-void expect_nxt(char *op);
+void expect_nxt(TokenKind kind);
 int expect_num_nxt(void);
 void expect_ident_nxt(void);
 void expect_ident(void);
@@ -142,11 +309,20 @@ typedef enum {
 
 typedef struct Type Type;
 
+/**
+ * @brief 型. 同じ型のオブジェクトは1つしか作らない(pointer_to, array_of)
+ * @param pointer この型へのポインタ型(作ってあれば)
+ * @param arrays この型の配列型のリスト. next_arrayでつながる
+ * 
+ */
 struct Type {
 	TypeKind ty;
 	struct Type *ptr_to;
 	int _sizeof;
 	size_t array_size;
+	Type *pointer;
+	Type *arrays;
+	Type *next_array;
 };
 
 typedef struct Var Var;
@@ -154,18 +330,23 @@ typedef struct Var Var;
 struct Var {
 	Var *next;
 	char *name;
-	int len;
+	// internした番号
+	int id;
 	int offset;
 	Type *type;
 	bool is_write;
+	// レジスタに載せるローカル変数の仮想レジスタ. 0ならメモリに置く
+	int vreg;
 };
 
 typedef struct Node Node;
 
 /**
  * @brief 抽象構文木の頂点の定義
- * @param lhs 左の子ノード
- * @param rhs 右の子ノード
+ * kindごとに使うフィールドが違うので、共通部分の後ろを共用体にしている.
+ * new_nodeはkindで使う分だけを確保するので、共用体の他のメンバに触ってはいけない
+ * @param lhs 左の子ノード. ND_WHILEのときは条件
+ * @param rhs 右の子ノード. ND_WHILEのときは本体
  * @param condition ND_IFのときの条件またはND_FORのときの条件
  * @param them_stmt ND_IFまたはND_FORのときの条件を満たした場合のステートメント
  * @param else_stmt ND_IFのときの条件を満たさなかった場合のステートメント
@@ -176,35 +357,42 @@ typedef struct Node Node;
 struct Node {
 	// ノードの種類
 	NodeKind kind;
-	// 左の子のアドレス
-	Node *lhs;
-	// 右の子のアドレス
-	Node *rhs;
-	// 数値
-	int val;
-	// 変数だったときの、rbpからのオフセット
-	int offset;
+	// type_analyzerで型を決め終わった
+	bool typed;
 	// 変数の型
 	Type *type;
-
-	// if
-	Node *condition;
-	Node *then_stmt;
-	Node *else_stmt;
-
-	// for 以下の変数とconditionとthen_stmtを使う
-	Node *init;
-	Node *loop;
-
-	// block
+	// ブロック内の文、関数の文、実引数、仮引数の並びの次
 	Node *next;
 
-	// function call
-	char *funcname;
-	Node *next_stmt;
-	Node *next_arg;
-	//
-	char *var_name;
+	union {
+		// 二項演算, 代入, return, &, *, while
+		struct {
+			Node *lhs;
+			Node *rhs;
+		};
+		// ND_NUM
+		int val;
+		// ND_LVAR, ND_GVAR, ND_ARG
+		Var *var;
+		// ND_IF, ND_FOR
+		struct {
+			Node *condition;
+			Node *then_stmt;
+			Node *else_stmt;
+			Node *init;
+			Node *loop;
+		};
+		// ND_BLOCK
+		Node *body;
+		// ND_FUNCALL
+		struct {
+			char *funcname;
+			// internした番号
+			int func_id;
+			Node *args;
+			int arg_count;
+		};
+	};
 };
 
 typedef struct Function Function;
@@ -215,31 +403,242 @@ typedef struct Function Function;
  */
 struct Function {
 	char *name;
+	// internした番号
+	int id;
 	int arg_count;
 	Node *arg;
 	Node *stmt;
 	Function *next;
 	int total_offset;
+	// ローカル変数のリスト. 最後は番兵
 	Var *local;
 	Type *type;
+	// ローカル変数のアドレスを取っている
+	bool addr_taken;
+	// インライン展開できる関数の式と仮引数. 展開できなければNULL
+	Node *inline_expr;
+	Var **inline_param;
+	// inline_exprが関数を呼ぶ
+	bool inline_has_call;
+	// inline_exprがグローバル変数やポインタの先を読む
+	bool inline_reads_mem;
 };
 
 extern Var *gvar_list;
 extern Function *func_list;
-Function *find_func(char *name);
+Function *find_func(int id);
+Node *new_node(NodeKind kind);
+Node *copy_node(Node *node, Arena *arena);
 void program(void);
 
+////////////////////////////////////////////////////////////////////////////
+// fold.c
+////////////////////////////////////////////////////////////////////////////
+
+void fold_function(Function *func);
+
+////////////////////////////////////////////////////////////////////////////
+// inline.c
+////////////////////////////////////////////////////////////////////////////
+
+extern bool inline_enabled;
+void inline_register(Function *func);
+void inline_calls(Function *func);
+
+////////////////////////////////////////////////////////////////////////////
+// ir.c
+////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief 中間表現の命令の種類. 3番地コードで、値はすべて仮想レジスタ(v1, v2, ...)に入れる
+ * 
+ */
+typedef enum {
+	IR_IMM,		// dst = imm
+	IR_MOV,		// dst = a
+	IR_ADD,		// dst = a + b
+	IR_SUB,		// dst = a - b
+	IR_MUL,		// dst = a * b
+	IR_DIV,		// dst = a / b
+	IR_EQ,		// dst = a == b
+	IR_NE,		// dst = a != b
+	IR_LT,		// dst = a < b
+	IR_LE,		// dst = a <= b
+	IR_SHL,		// dst = a << imm
+	IR_SAR,		// dst = a >> imm (算術シフト)
+	IR_SHR,		// dst = a >> imm (論理シフト)
+	IR_MULHI,	// dst = (a * b)の上位64ビット(符号付き)
+	IR_LEA,		// dst = a + b * imm (imm: 1, 2, 4, 8)
+	IR_LADDR,	// dst = ローカル変数のアドレス (imm: 変数のオフセット)
+	IR_GADDR,	// dst = グローバル変数のアドレス (name)
+	IR_LOAD,	// dst = *a (size: 1 or 8)
+	IR_STORE,	// *a = b (size: 1 or 8)
+	IR_PARAM,	// dst = imm番目の引数
+	IR_CALL,	// dst = name(args...)
+	// ここから下は基本ブロックの終端にだけ置ける
+	IR_JMP,		// goto then
+	IR_BR,		// if (a) goto then; else goto els
+	IR_BEQ,		// if (a == b) goto then; else goto els
+	IR_BNE,		// if (a != b) goto then; else goto els
+	IR_BLT,		// if (a < b) goto then; else goto els
+	IR_BLE,		// if (a <= b) goto then; else goto els
+	IR_RET,		// return a
+	IR_TAILCALL,	// return name(args...). フレームを片付けてから飛ぶ
+} IRKind;
+
+// 引数を渡すレジスタの数. これより多い引数には対応しない
+#define MAX_ARGS 6
+
+typedef struct IRInsn IRInsn;
+typedef struct BasicBlock BasicBlock;
+typedef struct IRFunc IRFunc;
+
+struct IRInsn {
+	IRKind kind;
+	// 仮想レジスタの番号. 0は「なし」
+	int dst;
+	int a;
+	int b;
+	long imm;
+	// IR_LOAD, IR_STOREで読み書きするバイト数
+	int size;
+	// IR_GADDRの変数名またはIR_CALLの関数名
+	char *name;
+	// IR_CALLの引数
+	int *args;
+	int arg_count;
+	// IR_JMPと条件分岐の飛び先
+	BasicBlock *then;
+	BasicBlock *els;
+	IRInsn *prev;
+	IRInsn *next;
+};
+
+/**
+ * @brief 基本ブロック. 最後の命令だけが分岐(IR_JMP, IR_BR, IR_RET)になる
+ * 
+ */
+struct BasicBlock {
+	int id;
+	IRInsn *head;
+	IRInsn *tail;
+	// 出力する順番での次のブロック
+	BasicBlock *next;
+	// 前任ブロック. ir_cfgで計算する
+	BasicBlock **preds;
+	int pred_count;
+	// ループの先頭(後ろ向きの分岐の飛び先). 出力するときに揃える
+	bool loop_head;
+	// 各パスの作業用
+	int mark;
+};
+
+struct IRFunc {
+	char *name;
+	Function *func;
+	// 先頭のブロック. nextをたどると全ブロックを出力順に見られる
+	BasicBlock *entry;
+	int block_count;
+	int vreg_count;
+	// ローカル変数の領域の大きさ(8の倍数)
+	int local_size;
+	// regallocで決めた各仮想レジスタの物理レジスタ. -1ならスタックに置く
+	int *reg;
+};
+
+extern bool dump_ir;
+
+IRFunc *ir_build(Function *func);
+bool ir_is_terminator(IRKind kind);
+bool ir_is_cond_branch(IRKind kind);
+int ir_succs(BasicBlock *bb, BasicBlock **succs);
+int ir_uses(IRInsn *insn, int *uses);
+int ir_new_vreg(IRFunc *ir);
+BasicBlock *ir_new_block(IRFunc *ir);
+IRInsn *ir_insert_before(BasicBlock *bb, IRInsn *pos, IRKind kind);
+void ir_remove(BasicBlock *bb, IRInsn *insn);
+void ir_rename_uses(IRInsn *insn, int *map);
+void ir_cfg(IRFunc *ir);
+void ir_verify(IRFunc *ir);
+void ir_dump(IRFunc *ir);
+
+////////////////////////////////////////////////////////////////////////////
+// reduce.c
+////////////////////////////////////////////////////////////////////////////
+
+void ir_reduce(IRFunc *ir);
+void ir_dce(IRFunc *ir);
+
+////////////////////////////////////////////////////////////////////////////
+// loop.c
+////////////////////////////////////////////////////////////////////////////
+
+void ir_loop(IRFunc *ir);
+
+////////////////////////////////////////////////////////////////////////////
+// regalloc.c
+////////////////////////////////////////////////////////////////////////////
+
+#define REG_COUNT 11
+
+extern char *reg_name[REG_COUNT];
+extern char *reg_name8[REG_COUNT];
+extern bool reg_callee_saved[REG_COUNT];
+
+void regalloc(IRFunc *ir);
+
 ////////////////////////////////////////////////////////////////////////////
 // codegen.c
 ////////////////////////////////////////////////////////////////////////////
 
+extern bool check_align;
 void func_gen(Function *func);
 
+////////////////////////////////////////////////////////////////////////////
+// emit.c
+////////////////////////////////////////////////////////////////////////////
+
+typedef void (*EmitSinkFn)(void *ctx, char *data, size_t len);
+
+typedef struct EmitMem EmitMem;
+
+/**
+ * @brief emit_to_memで使うメモリ上の出力先
+ * 
+ */
+struct EmitMem {
+	char *data;
+	size_t len;
+	size_t cap;
+};
+
+void emit(char *fmt, ...);
+void emit_flush(void);
+void emit_to_fd(int fd);
+void emit_to_file(char *path);
+void emit_to_mem(EmitMem *mem);
+void emit_to_sink(EmitSinkFn fn, void *ctx);
+void emit_close(void);
+void emit_capture_begin(void);
+char *emit_capture_end(size_t *len);
+
+////////////////////////////////////////////////////////////////////////////
+// peephole.c
+////////////////////////////////////////////////////////////////////////////
+
+extern bool peephole_enabled;
+void peephole(char *text, size_t len);
+void peephole_report(void);
+
 ////////////////////////////////////////////////////////////////////////////
 // type_analyze.c
 ////////////////////////////////////////////////////////////////////////////
 
-Type *new_type(TypeKind typekind, Type *ptr_to, int sz);
+extern Type *ty_int;
+extern Type *ty_char;
+
+Type *pointer_to(Type *base);
+Type *array_of(Type *base, int n);
 bool is_int(Type *type);
 bool is_ptr(Type *type);
 bool is_array(Type *type);
@@ -0,0 +1,122 @@
+/**
+ * @file arena.c
+ * @author Takamasa Naruse
+ * @brief bump-pointer arena allocator
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "SverigeCC.h"
+
+// 1チャンクの大きさ. これより大きい要求は専用のチャンクを確保する
+#define ARENA_CHUNK_SIZE (1 << 20)
+#define ARENA_ALIGN 16
+
+Arena node_arena = {"node"};
+Arena global_arena = {"global"};
+Arena type_arena = {"type"};
+Arena ident_arena = {"ident"};
+
+bool arena_debug;
+
+static size_t align_up(size_t n) {
+	return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static ArenaChunk *new_chunk(Arena *arena, size_t size) {
+	size_t cap = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+	// callocの大きな領域はmmapされたゼロページなので、ゼロ埋めのコストはかからない
+	ArenaChunk *chunk = calloc(1, sizeof(ArenaChunk) + cap);
+	if (chunk == NULL) error("out of memory (arena %s)\n", arena->name);
+	chunk->cap = cap;
+	chunk->next = arena->head;
+	arena->head = chunk;
+	arena->reserved += cap;
+	arena->chunk_count++;
+	return chunk;
+}
+
+/**
+ * @brief arenaから0で初期化された領域を確保する
+ *
+ * @param arena
+ * @param size
+ * @return void*
+ */
+void *arena_alloc(Arena *arena, size_t size) {
+	size = align_up(size);
+	ArenaChunk *chunk = arena->head;
+	if (chunk == NULL || chunk->cap - chunk->used < size) chunk = new_chunk(arena, size);
+	void *res = chunk->data + chunk->used;
+	chunk->used += size;
+	arena->used += size;
+	if (arena->used > arena->peak) arena->peak = arena->used;
+	return res;
+}
+
+/**
+ * @brief arenaの全チャンクをまとめて解放する
+ *
+ * @param arena
+ */
+void arena_free(Arena *arena) {
+	ArenaChunk *chunk = arena->head;
+	while (chunk) {
+		ArenaChunk *nxt = chunk->next;
+		free(chunk);
+		chunk = nxt;
+	}
+	arena->head = NULL;
+	arena->used = 0;
+	arena->reserved = 0;
+	arena->chunk_count = 0;
+}
+
+/**
+ * @brief arenaを空にする. 標準の大きさのチャンクを1つだけ残して使い回す
+ *
+ * @param arena
+ */
+void arena_reset(Arena *arena) {
+	ArenaChunk *keep = NULL;
+	ArenaChunk *chunk = arena->head;
+	while (chunk) {
+		ArenaChunk *nxt = chunk->next;
+		if (keep == NULL && chunk->cap == ARENA_CHUNK_SIZE) keep = chunk;
+		else {
+			arena->reserved -= chunk->cap;
+			arena->chunk_count--;
+			free(chunk);
+		}
+		chunk = nxt;
+	}
+	if (keep) {
+		// arena_allocは0で初期化された領域を返すので、使った分だけ埋め直す
+		memset(keep->data, 0, keep->used);
+		keep->used = 0;
+		keep->next = NULL;
+	}
+	arena->head = keep;
+	arena->used = 0;
+}
+
+static void report(Arena *arena) {
+	fprintf(stderr, "arena %-6s: %zu bytes used (peak %zu), %zu bytes reserved, %d chunks\n",
+		arena->name, arena->used, arena->peak, arena->reserved, arena->chunk_count);
+}
+
+/**
+ * @brief 各arenaの使用量をエラー出力に書き出す(--arena-statsのとき)
+ *
+ */
+void arena_report(void) {
+	size_t token_size = sizeof(unsigned char) + sizeof(int) * 3;
+	fprintf(stderr, "tokens      : %d tokens, %zu bytes reserved\n", tokens.count, TOKEN_RING_SIZE * token_size);
+	report(&node_arena);
+	report(&global_arena);
+	report(&type_arena);
+	report(&ident_arena);
+}
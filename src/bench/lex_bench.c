@@ -0,0 +1,63 @@
+/**
+ * @file lex_bench.c
+ * @author Takamasa Naruse
+ * @brief lexing throughput micro-benchmark (make bench)
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+#include "SverigeCC.h"
+#include <time.h>
+
+char *user_input;
+char *user_input_end;
+char *input_path = "<bench>";
+int opt_level;
+
+// 生成されたコードに近い入力: 長い識別子、インデント、数字
+static char *make_input(size_t size) {
+	char *buf = malloc(size + 256);
+	size_t len = 0;
+	for (int i = 0; len < size; i++) {
+		len += sprintf(buf + len,
+			"        generated_variable_name_%d = generated_variable_name_%d + 1234567 * %d;\n",
+			i, i + 1, i % 1000);
+	}
+	user_input = buf;
+	user_input_end = buf + len;
+	return buf;
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double run(int iterations) {
+	double start = now();
+	for (int i = 0; i < iterations; i++) {
+		tokenize(user_input, user_input_end);
+		while (!at_eof()) next();
+	}
+	return now() - start;
+}
+
+int main(int argc, char **argv) {
+	size_t size = 16 << 20;
+	int iterations = argc > 1 ? atoi(argv[1]) : 5;
+	make_input(size);
+	double mb = (double)(user_input_end - user_input) * iterations / (1 << 20);
+
+	static char *names[] = {"", "scalar", "sse2", "avx2"};
+	for (ScanLevel level = SCAN_SCALAR; level <= SCAN_AVX2; level++) {
+		if (scan_init(level) != level) continue;
+		run(1);
+		double sec = run(iterations);
+		printf("%-6s: %8.1f MB/s\n", names[level], mb / sec);
+	}
+	free(user_input);
+	return 0;
+}
@@ -10,298 +10,439 @@
  */
 #include "SverigeCC.h"
 
-static char *argreg1[] = {"dil", "sil", "dl", "cl", "r8b", "r9b"};
+// 関数を呼ぶ直前にrspが16の倍数になっているかを実行時に確かめる(--check-align)
+bool check_align;
+
 static char *argreg8[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
 static int Label_id = 0;
-static int Total_offset;
+// 関数ごとの番号. ブロックのラベルを関数間で区別するのに使う
+static int Func_id = 0;
 
-static void gen(Node *node);
+// 出力中の関数と、各仮想レジスタの置き場所("QWORD PTR [rbp-16]"など)
+static IRFunc *fn;
+static char **vloc;
 
-static void load(Type *type) {
-	printf("  pop rax\n");
-	if (type->_sizeof == 8) {
-		printf("  mov rax, [rax]\n");
-	} else {
-		printf("  movsx rax, byte ptr [rax]\n");
-	}
-		printf("  push rax\n");
+// 使っているcallee-savedのレジスタと、それを退避する場所
+static bool callee_used[REG_COUNT];
+static int save_offset[REG_COUNT];
+
+// rspより下の、割り込みなどで壊されないことがABIで保証されている領域(red zone)の大きさ
+#define RED_ZONE_SIZE 128
+
+// 関数を呼ばず、スタックに置くものがred zoneに収まるならフレームを作らない.
+// そのときはrbpの代わりにrspを基準にしてred zoneを使う
+static bool no_frame;
+static char *frame_reg;
+
+static char *loc(int vreg) {
+	return vloc[vreg];
+}
+
+static bool in_reg(int vreg) {
+	return fn->reg[vreg] >= 0;
 }
 
-static void store(Type *type) {
-	printf("  pop rdi\n");
-	printf("  pop rax\n");
-	if (type->_sizeof == 8) {
-		printf("  mov [rax], rdi\n");
-	} else {
-		printf("  mov [rax], dil\n");
+static char *slot_name(int offset) {
+	char buf[64];
+	int len = snprintf(buf, sizeof(buf), "QWORD PTR [%s-%d]", frame_reg, offset);
+	char *res = arena_alloc(&node_arena, len + 1);
+	memcpy(res, buf, len);
+	return res;
+}
+
+// 末尾呼び出しは戻ってこないので、関数を呼ばないものとして数える
+static bool is_leaf(void) {
+	for (BasicBlock *bb = fn->entry; bb; bb = bb->next) {
+		for (IRInsn *insn = bb->head; insn; insn = insn->next) {
+			if (insn->kind == IR_CALL) return false;
+		}
 	}
-	printf("  push rdi\n");
+	return true;
 }
 
 /**
- * @brief push variable address
+ * @brief 仮想レジスタの置き場所を決める. レジスタに載らなかったものと、
+ * 退避するcallee-savedのレジスタは、ローカル変数の領域のすぐ下に8バイトずつ並べる
  * 
- * @param node 
+ * @return int rspから確保するスタックフレームの大きさ
  */
-static void addr_gen(Node *node) {
-	if (node->kind == ND_DEREF) {
-		gen(node->lhs);
-		return;
+static int assign_slots(void) {
+	// 先に全体の大きさを数えて、フレームを省けるか決める
+	int size = fn->local_size;
+	for (int r = 0; r < REG_COUNT; r++) callee_used[r] = false;
+	for (int v = 1; v <= fn->vreg_count; v++) {
+		int reg = fn->reg[v];
+		if (reg < 0) size += 8;
+		else if (reg_callee_saved[reg]) callee_used[reg] = true;
+	}
+	for (int r = 0; r < REG_COUNT; r++) {
+		if (callee_used[r]) size += 8;
+	}
+	no_frame = is_leaf() && size <= RED_ZONE_SIZE;
+	frame_reg = no_frame ? "rsp" : "rbp";
+
+	size = fn->local_size;
+	vloc = arena_alloc(&node_arena, sizeof(char *) * (fn->vreg_count + 1));
+	for (int v = 1; v <= fn->vreg_count; v++) {
+		int reg = fn->reg[v];
+		if (reg >= 0) vloc[v] = reg_name[reg];
+		else {
+			size += 8;
+			vloc[v] = slot_name(size);
+		}
 	}
-	if (node->kind != ND_LVAR && node->kind != ND_GVAR) {
-		error("代入の左辺値が変数ではありません\n");
+	for (int r = 0; r < REG_COUNT; r++) {
+		if (!callee_used[r]) continue;
+		size += 8;
+		save_offset[r] = size;
 	}
-	if (node->kind == ND_GVAR) {
-		printf("  push offset %s\n", node->var_name);
+	if (no_frame) return 0;
+	// push rbpの後でrspは16の倍数なので、フレームも16の倍数にすればcallの位置で揃う
+	return (size + 15) / 16 * 16;
+}
+
+static void block_label(BasicBlock *bb) {
+	// ループの先頭は毎周飛んでくるので16バイト境界に揃える. 10バイトより多く詰めるなら揃えない
+	if (bb->loop_head) emit("  .p2align 4,,10\n");
+	emit(".LBB%d_%d:\n", Func_id, bb->id);
+}
+
+static void jump(char *op, BasicBlock *bb) {
+	emit("  %s .LBB%d_%d\n", op, Func_id, bb->id);
+}
+
+// 退避したレジスタを戻してフレームを片付ける. rspは呼ばれたときの位置に戻る
+static void leave_frame(void) {
+	for (int r = 0; r < REG_COUNT; r++) {
+		if (callee_used[r]) emit("  mov %s, [%s-%d]\n", reg_name[r], frame_reg, save_offset[r]);
+	}
+	if (!no_frame) {
+		emit("  mov rsp, rbp\n");
+		emit("  pop rbp\n");
+	}
+}
+
+static void epilogue(void) {
+	leave_frame();
+	emit("  ret\n");
+}
+
+// 両方メモリにあるときは片方をraxに読んでから比べる
+static void cmp_operands(int a, int b) {
+	if (in_reg(a)) emit("  cmp %s, %s\n", loc(a), loc(b));
+	else {
+		emit("  mov rax, %s\n", loc(a));
+		emit("  cmp rax, %s\n", loc(b));
+	}
+}
+
+/**
+ * @brief 直前のcmpの結果で分岐する. 次のブロックがthenなら条件を反転してelsへ飛ぶ
+ *
+ * @param jcc 条件が成り立つときの分岐命令
+ * @param inv 条件が成り立たないときの分岐命令
+ */
+static void cond_jump(IRInsn *insn, char *jcc, char *inv, BasicBlock *next) {
+	if (insn->then == next) jump(inv, insn->els);
+	else if (insn->els == next) jump(jcc, insn->then);
+	else {
+		jump(jcc, insn->then);
+		jump("jmp", insn->els);
+	}
+}
+
+// raxの値をdstに入れる
+static void store_result(int dst) {
+	emit("  mov %s, rax\n", loc(dst));
+}
+
+static void compare(IRInsn *insn, char *set) {
+	cmp_operands(insn->a, insn->b);
+	emit("  %s al\n", set);
+	emit("  movzb rax, al\n");
+	store_result(insn->dst);
+}
+
+static void arith(IRInsn *insn, char *op) {
+	// dstがレジスタなら直接計算する. ただしdst = a op dstのときはbを先に壊してしまうので、raxを使う
+	if (in_reg(insn->dst) && insn->dst != insn->b) {
+		if (insn->dst != insn->a) emit("  mov %s, %s\n", loc(insn->dst), loc(insn->a));
+		emit("  %s %s, %s\n", op, loc(insn->dst), loc(insn->b));
 		return;
 	}
-	printf("  mov rax, rbp\n");
-	printf("  sub rax, %d\n", Total_offset + 8);
-	printf("  add rax, %d\n", node->offset);
-	printf("  push rax\n");
+	emit("  mov rax, %s\n", loc(insn->a));
+	emit("  %s rax, %s\n", op, loc(insn->b));
+	store_result(insn->dst);
+}
+
+static void shift(IRInsn *insn, char *op) {
+	if (in_reg(insn->dst)) {
+		if (insn->dst != insn->a) emit("  mov %s, %s\n", loc(insn->dst), loc(insn->a));
+		emit("  %s %s, %ld\n", op, loc(insn->dst), insn->imm);
+		return;
+	}
+	emit("  mov rax, %s\n", loc(insn->a));
+	emit("  %s rax, %ld\n", op, insn->imm);
+	store_result(insn->dst);
+}
+
+// メモリにある値は、アドレスとして使う前にraxに読む
+static char *addr_reg(int vreg) {
+	if (in_reg(vreg)) return loc(vreg);
+	emit("  mov rax, %s\n", loc(vreg));
+	return "rax";
+}
+
+static void call(IRInsn *insn) {
+	for (int i = 0; i < insn->arg_count; i++) {
+		emit("  mov %s, %s\n", argreg8[i], loc(insn->args[i]));
+	}
+	// 仕様上rspが16の倍数で関数をcallしなくてはならない.
+	// 関数の中でpush/popはしないので、フレームの大きさを16の倍数にしておけば常に揃っている
+	if (check_align) {
+		int id = Label_id++;
+		emit("  test rsp, 15\n");
+		emit("  jz .Laligned%d\n", id);
+		emit("  ud2\n");
+		emit(".Laligned%d:\n", id);
+	}
+	// 可変長引数の関数はalをベクタレジスタで渡した引数の数として読むので、0にしておく
+	emit("  xor eax, eax\n");
+	emit("  call %s\n", insn->name);
+	store_result(insn->dst);
+}
+
+/**
+ * @brief 引数を並べてからフレームを片付けて飛ぶ. 呼んだ先は自分の戻り先へ直接戻る.
+ * 引数の値はフレームの中にあるかもしれないので、片付ける前に読む
+ *
+ */
+static void tail_call(IRInsn *insn) {
+	for (int i = 0; i < insn->arg_count; i++) {
+		emit("  mov %s, %s\n", argreg8[i], loc(insn->args[i]));
+	}
+	leave_frame();
+	emit("  xor eax, eax\n");
+	emit("  jmp %s\n", insn->name);
 }
 
-static void gen(Node *node) {
-	switch (node->kind)
+/**
+ * @brief 中間表現の命令を1つ出力する. レジスタに載らなかった値はraxとr11を経由して読み書きする
+ * 
+ * @param insn 
+ * @param next 出力順で次のブロック. そこへの分岐は省く
+ */
+static void insn_gen(IRInsn *insn, BasicBlock *next) {
+	switch (insn->kind)
 	{
-	case ND_NUM:
-		printf("  push %d\n", node->val);
-		return;
-	case ND_LVAR:
-		addr_gen(node);
-		if (node->type->ty != TP_ARRAY) load(node->type);
-		return;
-	case ND_GVAR:
-		addr_gen(node);
-		if (node->type->ty != TP_ARRAY) load(node->type);
-		return;
-	case ND_ASSIGN:
-		addr_gen(node->lhs);
-		gen(node->rhs);
-		store(node->type);
-		return;
-	case ND_RETURN:
-		gen(node->lhs);
-		printf("  pop rax\n");
-		printf("  mov rsp, rbp\n");
-		printf("  pop rbp\n");
-		printf("  ret\n");
-		return;
-	case ND_IF:
-		gen(node->condition);
-		printf("  pop rax\n");
-		printf("  cmp rax, 0\n");
-		if (node->else_stmt) {
-			printf("  je .Lend%d\n", Label_id);
-			if (node->then_stmt) gen(node->then_stmt);
-			printf(".Lend%d:\n", Label_id);
-		} else {
-			printf("  je .Lelse%d\n", Label_id);
-			if (node->then_stmt) gen(node->then_stmt);
-			printf("  jmp .Lend%d\n", Label_id);
-			printf(".Lelse%d:\n", Label_id);
-			if (node->else_stmt) gen(node->else_stmt);
-			printf(".Lend%d:\n", Label_id);
-		}
-		Label_id++;
-		return;
-	case ND_WHILE:
-		printf(".Lbegin%d:\n", Label_id);
-		gen(node->lhs);
-		printf("  pop rax\n");
-		printf("  cmp rax, 0\n");
-		printf("  je .Lend%d\n", Label_id);
-		if (node->rhs) gen(node->rhs);
-		printf("  jmp .Lbegin%d\n", Label_id);
-		printf(".Lend%d:\n", Label_id);
-		Label_id++;
-		return;
-	case ND_FOR:
-		if (node->init) gen(node->init);
-		printf(".Lbegin%d:\n", Label_id);
-		if (node->condition) {
-			gen(node->condition);
-			printf("  pop rax\n");
-			printf("  cmp rax, 0\n");
-			printf("  je .Lend%d\n", Label_id);
+	case IR_IMM:
+		// メモリへ直接書けるのは32ビットに収まる値だけ
+		if (in_reg(insn->dst) || insn->imm == (int)insn->imm) emit("  mov %s, %ld\n", loc(insn->dst), insn->imm);
+		else {
+			emit("  mov rax, %ld\n", insn->imm);
+			store_result(insn->dst);
 		}
-		if (node->then_stmt) gen(node->then_stmt);
-		if (node->loop) gen(node->loop);
-		printf("  jmp .Lbegin%d\n", Label_id);
-		printf(".Lend%d:\n", Label_id);
-		Label_id++;
-		return;
-	case ND_BLOCK:
-		for (Node *now = node->next; now ; now = now->next) {
-			gen(now);
-			printf("  pop rax\n");
+		return;
+	case IR_MOV:
+		if (insn->dst == insn->a) return;
+		if (in_reg(insn->dst) || in_reg(insn->a)) emit("  mov %s, %s\n", loc(insn->dst), loc(insn->a));
+		else {
+			emit("  mov rax, %s\n", loc(insn->a));
+			store_result(insn->dst);
 		}
-		// main関数で"  pop rax"が必ず実行されるので、for文で全部"  pop rax"するとマズい.
-		// だから、"  push rax"して直近に取り出されたやつだけまたpushする.
-		printf("  push rax\n");
 		return;
-	case ND_FUNCALL:
+	case IR_ADD:
+		arith(insn, "add");
+		return;
+	case IR_SUB:
+		arith(insn, "sub");
+		return;
+	case IR_MUL:
+		arith(insn, "imul");
+		return;
+	case IR_SHL:
+		shift(insn, "shl");
+		return;
+	case IR_SAR:
+		shift(insn, "sar");
+		return;
+	case IR_SHR:
+		shift(insn, "shr");
+		return;
+	case IR_MULHI:
+		// rdx:rax = rax * b
+		emit("  mov rax, %s\n", loc(insn->a));
+		emit("  imul %s\n", loc(insn->b));
+		emit("  mov %s, rdx\n", loc(insn->dst));
+		return;
+	case IR_LEA:
 		{
-			int arg_count = 0;
-			for (Node *now = node->next; now ; now = now->next) {
-				gen(now);
-				arg_count++;
+			char *a = in_reg(insn->a) ? loc(insn->a) : "rax";
+			char *b = in_reg(insn->b) ? loc(insn->b) : "r11";
+			if (!in_reg(insn->a)) emit("  mov rax, %s\n", loc(insn->a));
+			if (!in_reg(insn->b)) emit("  mov r11, %s\n", loc(insn->b));
+			if (in_reg(insn->dst)) emit("  lea %s, [%s+%s*%ld]\n", loc(insn->dst), a, b, insn->imm);
+			else {
+				emit("  lea rax, [%s+%s*%ld]\n", a, b, insn->imm);
+				store_result(insn->dst);
 			}
-			for (int i = arg_count - 1; i >= 0; i--) {
-				printf("  pop %s\n", argreg8[i]);
+		}
+		return;
+	case IR_DIV:
+		emit("  mov rax, %s\n", loc(insn->a));
+		emit("  cqo\n");
+		emit("  idiv %s\n", loc(insn->b));
+		store_result(insn->dst);
+		return;
+	case IR_EQ:
+		compare(insn, "sete");
+		return;
+	case IR_NE:
+		compare(insn, "setne");
+		return;
+	case IR_LT:
+		compare(insn, "setl");
+		return;
+	case IR_LE:
+		compare(insn, "setle");
+		return;
+	case IR_LADDR:
+		// ローカル変数は rbp - (local_size + 8) + offset にある(フレームがなければrbpの代わりにrsp)
+		if (in_reg(insn->dst)) emit("  lea %s, [%s-%ld]\n", loc(insn->dst), frame_reg, fn->local_size + 8 - insn->imm);
+		else {
+			emit("  lea rax, [%s-%ld]\n", frame_reg, fn->local_size + 8 - insn->imm);
+			store_result(insn->dst);
+		}
+		return;
+	case IR_GADDR:
+		if (in_reg(insn->dst)) emit("  lea %s, [rip+%s]\n", loc(insn->dst), insn->name);
+		else {
+			emit("  lea rax, [rip+%s]\n", insn->name);
+			store_result(insn->dst);
+		}
+		return;
+	case IR_LOAD:
+		{
+			char *addr = addr_reg(insn->a);
+			char *dst = in_reg(insn->dst) ? loc(insn->dst) : "rax";
+			if (insn->size == 8) emit("  mov %s, [%s]\n", dst, addr);
+			else emit("  movsx %s, byte ptr [%s]\n", dst, addr);
+			if (!in_reg(insn->dst)) store_result(insn->dst);
+		}
+		return;
+	case IR_STORE:
+		{
+			char *addr = addr_reg(insn->a);
+			if (insn->size == 8) {
+				if (in_reg(insn->b)) emit("  mov [%s], %s\n", addr, loc(insn->b));
+				else {
+					emit("  mov r11, %s\n", loc(insn->b));
+					emit("  mov [%s], r11\n", addr);
+				}
+			} else {
+				if (in_reg(insn->b)) emit("  mov [%s], %s\n", addr, reg_name8[fn->reg[insn->b]]);
+				else {
+					emit("  mov r11, %s\n", loc(insn->b));
+					emit("  mov [%s], r11b\n", addr);
+				}
 			}
-			// 仕様上rspが16の倍数で関数をcallしなくてはならない
-			printf("  mov rax, rsp\n");
-			printf("  and rax, 15\n");
-			printf("  jnz .Lcall%d\n", Label_id);
-			printf("  call %s\n", node->funcname);
-			printf("  jmp .Lend%d\n", Label_id);
-			printf(".Lcall%d:\n", Label_id);
-			printf("  sub rsp, 8\n");
-			printf("  mov rax, 0\n");
-			printf("  call %s\n", node->funcname);
-			printf("  add rsp, 8\n");
-			printf(".Lend%d:\n", Label_id);
-			printf("  push rax\n");
-			Label_id++;
 		}
 		return;
-	case ND_ADDR:
-		addr_gen(node->lhs);
+	case IR_PARAM:
+		// 受け取ったレジスタにそのまま置かれた引数は動かさない
+		if (strcmp(loc(insn->dst), argreg8[insn->imm]) != 0) emit("  mov %s, %s\n", loc(insn->dst), argreg8[insn->imm]);
 		return;
-	case ND_DEREF:
-		gen(node->lhs);
-		if (node->type->ty != TP_ARRAY) load(node->type);
+	case IR_CALL:
+		call(insn);
 		return;
-	case ND_NULL:
+	case IR_TAILCALL:
+		tail_call(insn);
+		return;
+	case IR_JMP:
+		if (insn->then != next) jump("jmp", insn->then);
+		return;
+	case IR_BR:
+		if (in_reg(insn->a)) emit("  cmp %s, 0\n", loc(insn->a));
+		else {
+			emit("  mov rax, %s\n", loc(insn->a));
+			emit("  cmp rax, 0\n");
+		}
+		cond_jump(insn, "jne", "je", next);
+		return;
+	case IR_BEQ:
+		cmp_operands(insn->a, insn->b);
+		cond_jump(insn, "je", "jne", next);
+		return;
+	case IR_BNE:
+		cmp_operands(insn->a, insn->b);
+		cond_jump(insn, "jne", "je", next);
+		return;
+	case IR_BLT:
+		cmp_operands(insn->a, insn->b);
+		cond_jump(insn, "jl", "jge", next);
+		return;
+	case IR_BLE:
+		cmp_operands(insn->a, insn->b);
+		cond_jump(insn, "jle", "jg", next);
+		return;
+	case IR_RET:
+		emit("  mov rax, %s\n", loc(insn->a));
+		epilogue();
 		return;
-	default:
-		break;
-	}
-
-	// 比較演算の記号のひっくり返し
-	if (node->kind == ND_GE) {
-		gen(node->rhs);
-		gen(node->lhs);
-		node->kind = ND_LE;
-	} else if (node->kind == ND_GT) {
-		gen(node->rhs);
-		gen(node->lhs);
-		node->kind = ND_LT;
-	} else {
-		gen(node->lhs);
-		gen(node->rhs);
-	}
-
-	// ここ以降は算術演算と比較
-	// 算術と比較は最後に必ずpushされる
-	printf("  pop rdi\n");
-	printf("  pop rax\n");
-	switch (node->kind)
-	{
-	case ND_ADD:
-		printf("  add rax, rdi\n");
-		break;
-	case ND_PTR_ADD:
-		if (node->lhs->type->ty == TP_ARRAY) {
-			printf("  imul rdi, %d\n", node->lhs->type->ptr_to->_sizeof);
-		} else printf("  imul rdi, %d\n", node->lhs->type->_sizeof);
-		printf("  add rax, rdi\n");
-		break;
-	case ND_SUB:
-		printf("  sub rax, rdi\n");
-		break;
-	case ND_PTR_SUB:
-		printf("  imul rdi, %d\n", node->lhs->type->_sizeof);
-		printf("  sub rax, rdi\n");
-		break;
-	case ND_PTR_DIFF:
-		printf("  sub rax, rdi\n");
-		printf("  cqo\n");
-		printf("  mov rdi, %d\n", node->lhs->type->_sizeof);
-		printf("  idiv rdi\n");
-		break;
-	case ND_MUL:
-		printf("  imul rax, rdi\n");
-		break;
-	case ND_DIV:
-		printf("  cqo\n");
-		printf("  idiv rdi\n");
-		break;
-	case ND_EQ:
-		printf("  cmp rax, rdi\n");
-		printf("  sete al\n");
-		printf("  movzb rax, al\n");
-		break;
-	case ND_NEQ:
-		printf("  cmp rax, rdi\n");
-		printf("  setne al\n");
-		printf("  movzb rax, al\n");
-		break;
-	case ND_LE:
-		printf("  cmp rax, rdi\n");
-		printf("  setle al\n");
-		printf("  movzb rax, al\n");
-		break;
-	case ND_LT:
-		printf("  cmp rax, rdi\n");
-		printf("  setl al\n");
-		printf("  movzb rax, al\n");
-		break;
-	default:
-		break;
 	}
-	printf("  push rax\n");
 }
 
 static void gvar_gen() {
-	printf(".data\n");
+	emit(".data\n");
 	for (Var *now = gvar_list; now->is_write == false; now = now->next) {
-		printf("%s:\n", now->name);
-		printf("  .zero %d\n", now->type->_sizeof);
+		emit("%s:\n", now->name);
+		emit("  .zero %d\n", now->type->_sizeof);
 		now->is_write = true;
 	}
 }
 
-static int calc_align(int offset, int align) {
-	return (offset + align - 1) & ~(align - 1);
-}
-
 void func_gen(Function *func) {
 	if (func == NULL) {
 		gvar_gen();
 		return;
 	}
-	func->total_offset = calc_align(func->total_offset, 8);
-	printf(".text\n");
-	printf(".global %s\n", func->name);
-	printf("%s:\n", func->name);
+	fn = ir_build(func);
+	ir_verify(fn);
+	if (opt_level >= 1) {
+		ir_reduce(fn);
+		ir_loop(fn);
+		ir_dce(fn);
+		ir_verify(fn);
+	}
+	if (dump_ir) ir_dump(fn);
+	regalloc(fn);
 
-	// prologue
-	// ローカル変数領域の確保
-	printf("  push rbp\n");
-	printf("  mov rbp, rsp\n");
-	printf("  sub rsp, %d\n", func->total_offset);
+	int frame_size = assign_slots();
+	// 関数1つ分の命令をためて、peepholeを通してから出力する
+	emit_capture_begin();
+	emit(".text\n");
+	emit(".global %s\n", fn->name);
+	emit("%s:\n", fn->name);
 
-	Total_offset = func->total_offset;
-	// このアドレスの並びであってるのかな-??
-	int arg1_idx = 0, arg8_idx = 0;
-	for (Node *now = func->arg; now; now = now->next_arg) {
-		printf("  mov rax, rbp\n");
-		printf("  sub rax, %d\n", Total_offset + 8);
-		printf("  add rax, %d\n", now->offset);
-		if (is_char(now->type)) printf("  mov [rax], %s\n", argreg1[arg1_idx++]);
-		else printf("  mov [rax], %s\n", argreg8[arg8_idx++]);
+	// prologue
+	// ローカル変数とスタックに置く仮想レジスタの領域の確保
+	if (!no_frame) {
+		emit("  push rbp\n");
+		emit("  mov rbp, rsp\n");
+		emit("  sub rsp, %d\n", frame_size);
 	}
-
-	// statement
-	for (Node *now = func->stmt; now; now = now->next_stmt) {
-		gen(now);
+	for (int r = 0; r < REG_COUNT; r++) {
+		if (callee_used[r]) emit("  mov [%s-%d], %s\n", frame_reg, save_offset[r], reg_name[r]);
 	}
 
-	// epilogue
-	printf("  mov rsp, rbp\n");
-	printf("  pop rbp\n");
-	printf("  ret\n");
+	for (BasicBlock *bb = fn->entry; bb; bb = bb->next) {
+		block_label(bb);
+		for (IRInsn *insn = bb->head; insn; insn = insn->next) insn_gen(insn, bb->next);
+	}
+	size_t len;
+	char *text = emit_capture_end(&len);
+	peephole(text, len);
+	Func_id++;
+	fn = NULL;
 	return;
-}
\ No newline at end of file
+}
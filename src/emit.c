@@ -0,0 +1,220 @@
+/**
+ * @file emit.c
+ * @author Takamasa Naruse
+ * @brief buffered assembly writer
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "SverigeCC.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define EMIT_BUF_SIZE (1 << 16)
+
+static char buf[EMIT_BUF_SIZE];
+static size_t buf_len;
+
+// 出力先. sink_writeがNULLのときはsink_fdにwrite(2)する
+static int sink_fd = 1;
+static bool sink_fd_owned;
+static EmitSinkFn sink_write;
+static void *sink_ctx;
+
+// emit_capture_beginからemit_capture_endまでの出力は、書き出さずにここにためる
+static EmitMem capture;
+static bool capturing;
+
+static void write_fd(int fd, char *data, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(fd, data, len);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			error("write failed: %s\n", strerror(errno));
+		}
+		data += n;
+		len -= n;
+	}
+}
+
+static void mem_write(void *ctx, char *data, size_t len) {
+	EmitMem *mem = ctx;
+	if (mem->len + len + 1 > mem->cap) {
+		size_t cap = mem->cap ? mem->cap : EMIT_BUF_SIZE;
+		while (cap < mem->len + len + 1) cap *= 2;
+		mem->data = realloc(mem->data, cap);
+		if (mem->data == NULL) error("out of memory (emit)\n");
+		mem->cap = cap;
+	}
+	memcpy(mem->data + mem->len, data, len);
+	mem->len += len;
+	mem->data[mem->len] = '\0';
+}
+
+/**
+ * @brief バッファの中身を出力先に書き出す
+ *
+ */
+void emit_flush(void) {
+	if (buf_len == 0) return;
+	if (sink_write) sink_write(sink_ctx, buf, buf_len);
+	else write_fd(sink_fd, buf, buf_len);
+	buf_len = 0;
+}
+
+static void release_sink(void) {
+	emit_flush();
+	if (sink_fd_owned) close(sink_fd);
+	sink_fd = 1;
+	sink_fd_owned = false;
+	sink_write = NULL;
+	sink_ctx = NULL;
+}
+
+/**
+ * @brief 出力先をファイルディスクリプタ(標準出力やパイプ)にする
+ *
+ * @param fd
+ */
+void emit_to_fd(int fd) {
+	release_sink();
+	sink_fd = fd;
+}
+
+/**
+ * @brief 出力先をファイルにする. emit_closeで閉じる
+ *
+ * @param path
+ */
+void emit_to_file(char *path) {
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) error("cannot open %s: %s\n", path, strerror(errno));
+	release_sink();
+	sink_fd = fd;
+	sink_fd_owned = true;
+}
+
+/**
+ * @brief 出力先をメモリ上のバッファにする. mem->dataは常に'\0'終端される
+ *
+ * @param mem
+ */
+void emit_to_mem(EmitMem *mem) {
+	emit_to_sink(mem_write, mem);
+}
+
+/**
+ * @brief 出力先を呼び出し側の関数にする
+ *
+ * @param fn
+ * @param ctx fnの第1引数
+ */
+void emit_to_sink(EmitSinkFn fn, void *ctx) {
+	release_sink();
+	sink_write = fn;
+	sink_ctx = ctx;
+}
+
+/**
+ * @brief バッファを書き出し、emit_to_fileで開いたファイルを閉じて標準出力に戻す
+ *
+ */
+void emit_close(void) {
+	release_sink();
+}
+
+/**
+ * @brief これ以降の出力を書き出さずにメモリにためる. 関数1つ分の命令をpeepholeに渡すのに使う
+ *
+ */
+void emit_capture_begin(void) {
+	capturing = true;
+	capture.len = 0;
+}
+
+/**
+ * @brief ためるのをやめて、ためた出力を返す. 次にemit_capture_beginを呼ぶまで有効
+ *
+ * @param len ためたバイト数
+ * @return char* '\0'終端されている
+ */
+char *emit_capture_end(size_t *len) {
+	capturing = false;
+	*len = capture.len;
+	return capture.len ? capture.data : "";
+}
+
+static void put(char *s, size_t len) {
+	if (capturing) {
+		mem_write(&capture, s, len);
+		return;
+	}
+	if (buf_len + len > EMIT_BUF_SIZE) {
+		emit_flush();
+		if (len > EMIT_BUF_SIZE) {
+			if (sink_write) sink_write(sink_ctx, s, len);
+			else write_fd(sink_fd, s, len);
+			return;
+		}
+	}
+	memcpy(buf + buf_len, s, len);
+	buf_len += len;
+}
+
+static void put_int(long val) {
+	char tmp[21];
+	char *p = tmp + sizeof(tmp);
+	unsigned long u = val < 0 ? -(unsigned long)val : (unsigned long)val;
+	do {
+		*--p = '0' + u % 10;
+		u /= 10;
+	} while (u);
+	if (val < 0) *--p = '-';
+	put(p, tmp + sizeof(tmp) - p);
+}
+
+/**
+ * @brief アセンブリを1行分書く. 書式は%d(int), %ld(long), %s(文字列, レジスタ名), %%のみ
+ *
+ * @param fmt
+ * @param ...
+ */
+void emit(char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	char *p = fmt;
+	while (*p) {
+		char *q = p;
+		while (*q && *q != '%') q++;
+		if (q != p) put(p, q - p);
+		if (*q == '\0') break;
+		switch (q[1])
+		{
+		case 'd':
+			put_int(va_arg(ap, int));
+			break;
+		case 'l':
+			if (q[2] != 'd') error("emit: unknown format '%%l%c'\n", q[2]);
+			put_int(va_arg(ap, long));
+			q++;
+			break;
+		case 's':
+			{
+				char *s = va_arg(ap, char *);
+				put(s, strlen(s));
+			}
+			break;
+		case '%':
+			put("%", 1);
+			break;
+		default:
+			error("emit: unknown format '%%%c'\n", q[1]);
+		}
+		p = q + 2;
+	}
+	va_end(ap);
+}
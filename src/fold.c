@@ -0,0 +1,234 @@
+/**
+ * @file fold.c
+ * @author Takamasa Naruse
+ * @brief constant folding and algebraic simplification on the AST (-O1)
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "SverigeCC.h"
+#include <limits.h>
+
+// 畳み込む途中のノードを積む明示的なスタック. 深い式でもCのスタックを使わない.
+// ノードそのものではなく、ノードを指しているポインタの場所を積んでおき、そこを書き換えて置き換える
+typedef struct {
+	Node **slot;
+	// 子ノードを積み終わっていて、あとは自分を畳み込むだけ
+	bool expanded;
+} FoldFrame;
+
+static FoldFrame *frames;
+static int frame_len;
+static int frame_cap;
+
+static void push_frame(Node **slot, bool expanded) {
+	if (*slot == NULL) return;
+	if (frame_len == frame_cap) {
+		frame_cap = frame_cap ? frame_cap * 2 : 256;
+		frames = realloc(frames, frame_cap * sizeof(FoldFrame));
+		if (frames == NULL) error("out of memory (fold)\n");
+	}
+	frames[frame_len].slot = slot;
+	frames[frame_len].expanded = expanded;
+	frame_len++;
+}
+
+/**
+ * @brief 並び(next)を前から順に積む. スタックなので後ろの要素から畳み込まれ、
+ * 前の要素を置き換えるときには後ろがもう決まっている
+ *
+ */
+static void push_list(Node **head) {
+	for (Node **now = head; *now; now = &((*now)->next)) push_frame(now, false);
+}
+
+static void push_children(Node *node) {
+	switch (node->kind)
+	{
+	case ND_NUM:
+	case ND_LVAR:
+	case ND_GVAR:
+	case ND_ARG:
+	case ND_NULL:
+		return;
+	case ND_IF:
+		push_frame(&node->condition, false);
+		push_frame(&node->then_stmt, false);
+		push_frame(&node->else_stmt, false);
+		return;
+	case ND_FOR:
+		push_frame(&node->init, false);
+		push_frame(&node->condition, false);
+		push_frame(&node->then_stmt, false);
+		push_frame(&node->loop, false);
+		return;
+	case ND_BLOCK:
+		push_list(&node->body);
+		return;
+	case ND_FUNCALL:
+		push_list(&node->args);
+		return;
+	default:
+		push_frame(&node->lhs, false);
+		push_frame(&node->rhs, false);
+		return;
+	}
+}
+
+static Node *new_num(long val) {
+	Node *node = new_node(ND_NUM);
+	node->val = val;
+	node->type = ty_int;
+	node->typed = true;
+	return node;
+}
+
+static Node *new_null(void) {
+	Node *node = new_node(ND_NULL);
+	node->typed = true;
+	return node;
+}
+
+static bool is_num(Node *node, long val) {
+	return node->kind == ND_NUM && node->val == val;
+}
+
+// 評価しても副作用がない. 深い式をたどらずに済むよう、葉だけを見る
+static bool is_pure(Node *node) {
+	return node->kind == ND_NUM || node->kind == ND_LVAR || node->kind == ND_GVAR;
+}
+
+static bool same_var(Node *x, Node *y) {
+	return (x->kind == ND_LVAR || x->kind == ND_GVAR) && x->kind == y->kind && x->var == y->var;
+}
+
+/**
+ * @brief 両辺が定数の演算を計算する. 結果がintに収まらないときや0除算は実行時に任せる
+ *
+ * @return true 計算できた
+ */
+static bool eval(NodeKind kind, long x, long y, long *res) {
+	switch (kind)
+	{
+	case ND_ADD: *res = x + y; break;
+	case ND_SUB: *res = x - y; break;
+	case ND_MUL: *res = x * y; break;
+	case ND_DIV:
+		if (y == 0) return false;
+		*res = x / y;
+		break;
+	case ND_EQ: *res = x == y; break;
+	case ND_NEQ: *res = x != y; break;
+	case ND_LT: *res = x < y; break;
+	case ND_LE: *res = x <= y; break;
+	case ND_GT: *res = x > y; break;
+	case ND_GE: *res = x >= y; break;
+	default:
+		return false;
+	}
+	return INT_MIN <= *res && *res <= INT_MAX;
+}
+
+/**
+ * @brief 子ノードを畳み込み終わったnodeを簡単にする. 置き換えるノードを返す(そのままならnode)
+ *
+ * @param node
+ * @return Node*
+ */
+static Node *simplify(Node *node) {
+	switch (node->kind)
+	{
+	case ND_ADD:
+	case ND_SUB:
+	case ND_MUL:
+	case ND_DIV:
+	case ND_EQ:
+	case ND_NEQ:
+	case ND_LT:
+	case ND_LE:
+	case ND_GT:
+	case ND_GE:
+		{
+			Node *l = node->lhs, *r = node->rhs;
+			long res;
+			if (l->kind == ND_NUM && r->kind == ND_NUM && eval(node->kind, l->val, r->val, &res)) return new_num(res);
+			switch (node->kind)
+			{
+			case ND_ADD:
+				if (is_num(r, 0)) return l;
+				if (is_num(l, 0)) return r;
+				break;
+			case ND_SUB:
+				if (is_num(r, 0)) return l;
+				if (same_var(l, r)) return new_num(0);
+				break;
+			case ND_MUL:
+				if (is_num(r, 1)) return l;
+				if (is_num(l, 1)) return r;
+				if ((is_num(r, 0) && is_pure(l)) || (is_num(l, 0) && is_pure(r))) return new_num(0);
+				break;
+			case ND_DIV:
+				if (is_num(r, 1)) return l;
+				break;
+			default:
+				break;
+			}
+			return node;
+		}
+	case ND_PTR_ADD:
+	case ND_PTR_SUB:
+		// x[0]など. 型はlhsと同じなのでそのまま置き換えられる
+		if (is_num(node->rhs, 0)) return node->lhs;
+		return node;
+	case ND_IF:
+		if (node->condition->kind != ND_NUM) return node;
+		if (node->condition->val) return node->then_stmt ? node->then_stmt : new_null();
+		return node->else_stmt ? node->else_stmt : new_null();
+	case ND_WHILE:
+		{
+			if (node->lhs->kind != ND_NUM) return node;
+			if (node->lhs->val == 0) return new_null();
+			// 無限ループは条件のないforにする
+			Node *loop = new_node(ND_FOR);
+			loop->then_stmt = node->rhs;
+			loop->typed = true;
+			return loop;
+		}
+	case ND_FOR:
+		if (node->condition == NULL || node->condition->kind != ND_NUM) return node;
+		if (node->condition->val) {
+			node->condition = NULL;
+			return node;
+		}
+		// 一度も回らないので初期化の式だけが残る
+		return node->init ? node->init : new_null();
+	default:
+		return node;
+	}
+}
+
+/**
+ * @brief 関数の文を全部畳み込む. type_analyzerの後に呼ぶ
+ *
+ * @param func
+ */
+void fold_function(Function *func) {
+	push_list(&func->stmt);
+	while (frame_len > 0) {
+		FoldFrame frame = frames[--frame_len];
+		Node *node = *frame.slot;
+		if (!frame.expanded) {
+			push_frame(frame.slot, true);
+			push_children(node);
+			continue;
+		}
+		Node *res = simplify(node);
+		if (res == node) continue;
+		// 並びの途中のノードを置き換えても、後ろとのつながりは保つ
+		res->next = node->next;
+		*frame.slot = res;
+	}
+}
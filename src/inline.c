@@ -0,0 +1,364 @@
+/**
+ * @file inline.c
+ * @author Takamasa Naruse
+ * @brief inline expansion of small functions on the AST (-O1)
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "SverigeCC.h"
+
+// --no-inlineで切る
+bool inline_enabled = true;
+
+// 展開する関数の式のノード数の上限
+#define INLINE_BUDGET 32
+
+// 木をたどるための明示的なスタック. 深い式でもCのスタックを使わない.
+// ノードを指しているポインタの場所を積んでおき、そこを書き換えて置き換える
+typedef struct {
+	Node **slot;
+	// 子ノードを積み終わっていて、あとは自分を見るだけ
+	bool expanded;
+} InlineFrame;
+
+static InlineFrame *frames;
+static int frame_len;
+static int frame_cap;
+
+static void push_frame(Node **slot, bool expanded) {
+	if (*slot == NULL) return;
+	if (frame_len == frame_cap) {
+		frame_cap = frame_cap ? frame_cap * 2 : 256;
+		frames = realloc(frames, frame_cap * sizeof(InlineFrame));
+		if (frames == NULL) error("out of memory (inline)\n");
+	}
+	frames[frame_len].slot = slot;
+	frames[frame_len].expanded = expanded;
+	frame_len++;
+}
+
+static void push_slot(Node **slot) {
+	push_frame(slot, false);
+}
+
+static void push_children(Node *node) {
+	switch (node->kind)
+	{
+	case ND_NUM:
+	case ND_LVAR:
+	case ND_GVAR:
+	case ND_ARG:
+	case ND_NULL:
+		return;
+	case ND_IF:
+		push_slot(&node->condition);
+		push_slot(&node->then_stmt);
+		push_slot(&node->else_stmt);
+		return;
+	case ND_FOR:
+		push_slot(&node->init);
+		push_slot(&node->condition);
+		push_slot(&node->then_stmt);
+		push_slot(&node->loop);
+		return;
+	case ND_BLOCK:
+		for (Node **now = &node->body; *now; now = &(*now)->next) push_slot(now);
+		return;
+	case ND_FUNCALL:
+		for (Node **now = &node->args; *now; now = &(*now)->next) push_slot(now);
+		return;
+	default:
+		push_slot(&node->lhs);
+		push_slot(&node->rhs);
+		return;
+	}
+}
+
+static int param_index(Function *func, Var *var) {
+	for (int i = 0; i < func->arg_count; i++) {
+		if (func->inline_param[i] == var) return i;
+	}
+	return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// register
+////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief 式をfuncの外でも使えるようにarenaに複製する. 仮引数の変数はfunc->inline_paramに付け替える.
+ * ノード数は予算以下なので再帰してよい
+ *
+ */
+static Node *persist(Node *node, Function *func, Var **args, Arena *arena) {
+	if (node == NULL) return NULL;
+	Node *res = copy_node(node, arena);
+	res->next = NULL;
+	switch (node->kind)
+	{
+	case ND_NUM:
+	case ND_GVAR:
+		return res;
+	case ND_LVAR:
+		for (int i = 0; i < func->arg_count; i++) {
+			if (args[i] == node->var) res->var = func->inline_param[i];
+		}
+		return res;
+	case ND_FUNCALL:
+		{
+			Node **now = &res->args;
+			for (Node *arg = node->args; arg; arg = arg->next) {
+				*now = persist(arg, func, args, arena);
+				now = &(*now)->next;
+			}
+			return res;
+		}
+	default:
+		res->lhs = persist(node->lhs, func, args, arena);
+		res->rhs = persist(node->rhs, func, args, arena);
+		return res;
+	}
+}
+
+/**
+ * @brief 展開できる形か調べる. 仮引数だけを読み、代入をしない、予算以下の大きさの式に限る
+ *
+ */
+static bool can_inline(Function *func, Node *expr, Var **args) {
+	if (expr->type->ty != TP_INT && expr->type->ty != TP_CHAR) return false;
+	frame_len = 0;
+	push_slot(&expr);
+	int count = 0;
+	bool ok = true;
+	while (frame_len > 0 && ok) {
+		Node *node = *frames[--frame_len].slot;
+		if (++count > INLINE_BUDGET) ok = false;
+		switch (node->kind)
+		{
+		case ND_LVAR:
+			ok = false;
+			for (int i = 0; i < func->arg_count; i++) {
+				if (args[i] == node->var) ok = true;
+			}
+			break;
+		case ND_ADDR:
+			// 仮引数は呼び出し側の式に置き換わるので、アドレスは取れない
+			ok = node->lhs->kind == ND_GVAR;
+			break;
+		case ND_FUNCALL:
+			// 自分自身を呼ぶ関数は展開しない
+			if (node->funcname == func->name) ok = false;
+			func->inline_has_call = true;
+			break;
+		case ND_GVAR:
+		case ND_DEREF:
+			func->inline_reads_mem = true;
+			break;
+		case ND_ASSIGN:
+		case ND_IF:
+		case ND_WHILE:
+		case ND_FOR:
+		case ND_BLOCK:
+		case ND_RETURN:
+			ok = false;
+			break;
+		default:
+			break;
+		}
+		if (ok) push_children(node);
+	}
+	frame_len = 0;
+	return ok;
+}
+
+/**
+ * @brief 出力し終わったfuncが「return 式;」だけの小さな関数なら、後で定義される関数で展開できるように式を残しておく.
+ * 関数の抽象構文木は関数ごとに捨てるので、global_arenaに複製する
+ *
+ * @param func
+ */
+void inline_register(Function *func) {
+	func->inline_expr = NULL;
+	Node *stmt = func->stmt;
+	if (!inline_enabled || stmt == NULL || stmt->next || stmt->kind != ND_RETURN) return;
+	if (func->arg_count > MAX_ARGS) return;
+	Var *args[MAX_ARGS];
+	int i = 0;
+	for (Node *arg = func->arg; arg; arg = arg->next) {
+		// charの引数は受け取るときに切り詰められるので、そのまま置き換えられない
+		if (arg->var->type->_sizeof != 8) return;
+		args[i++] = arg->var;
+	}
+	func->inline_has_call = false;
+	func->inline_reads_mem = false;
+	if (!can_inline(func, stmt->lhs, args)) return;
+
+	func->inline_param = arena_alloc(&global_arena, sizeof(Var *) * (func->arg_count + 1));
+	for (i = 0; i < func->arg_count; i++) {
+		func->inline_param[i] = arena_alloc(&global_arena, sizeof(Var));
+		*func->inline_param[i] = *args[i];
+	}
+	func->inline_expr = persist(stmt->lhs, func, args, &global_arena);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// expand
+////////////////////////////////////////////////////////////////////////////
+
+// 後で定義される関数や、まだ登録していない出力中の関数はinline_exprがない
+static Function *find_inline(int id) {
+	Function *func = find_func(id);
+	return func && func->inline_expr ? func : NULL;
+}
+
+// 式の中で仮引数iが読まれる回数
+static int count_uses(Node *node, Function *callee, int i) {
+	if (node == NULL) return 0;
+	if (node->kind == ND_LVAR) return param_index(callee, node->var) == i;
+	if (node->kind == ND_FUNCALL) {
+		int n = 0;
+		for (Node *arg = node->args; arg; arg = arg->next) n += count_uses(arg, callee, i);
+		return n;
+	}
+	if (node->kind == ND_NUM || node->kind == ND_GVAR) return 0;
+	return count_uses(node->lhs, callee, i) + count_uses(node->rhs, callee, i);
+}
+
+/**
+ * @brief 何度読んでも、いつ読んでも同じ値になる実引数か.
+ * 呼び出し側のローカル変数は、アドレスを取られていなければ展開した式の中で書き換わらない.
+ * グローバル変数は、展開する式が関数を呼ばなければ書き換わらない
+ *
+ */
+static bool is_stable(Node *arg, Function *caller, Function *callee) {
+	switch (arg->kind)
+	{
+	case ND_NUM:
+		return true;
+	case ND_LVAR:
+		return !caller->addr_taken;
+	case ND_GVAR:
+		return !callee->inline_has_call;
+	default:
+		return false;
+	}
+}
+
+/**
+ * @brief 式が代入や関数呼び出しを含むか. 実引数は深いことがあるので、明示的なスタックでたどる.
+ * スタックは展開の途中でも使っているので、積んだ分だけ使って元の高さに戻す
+ *
+ */
+static bool has_side_effect(Node *node) {
+	int base = frame_len;
+	bool res = false;
+	push_slot(&node);
+	while (frame_len > base) {
+		Node *now = *frames[--frame_len].slot;
+		if (now->kind == ND_ASSIGN || now->kind == ND_FUNCALL) {
+			res = true;
+			frame_len = base;
+			break;
+		}
+		push_children(now);
+	}
+	return res;
+}
+
+/**
+ * @brief 呼び出しを展開してよいか. 値の変わらない実引数は何度でも複製して置き換える.
+ * それ以外の実引数は1つだけ、1度だけ読まれるならそのまま置き換えてよい.
+ * そのとき式の中で評価の順番が変わっても結果が変わらないよう、他の実引数は定数に限り、式は関数を呼ばないものに限る.
+ * 実引数が代入や呼び出しを含むなら、式の中でそれより先に読むメモリが書き換わりうるので、式はメモリを読まないものに限る
+ *
+ */
+static bool can_expand(Node *call, Function *caller, Function *callee) {
+	if (call->arg_count != callee->arg_count) return false;
+	int unstable = 0, non_const = 0, i = 0;
+	Node *moved = NULL;
+	for (Node *arg = call->args; arg; arg = arg->next, i++) {
+		if (arg->kind != ND_NUM) non_const++;
+		if (is_stable(arg, caller, callee)) continue;
+		if (count_uses(callee->inline_expr, callee, i) != 1) return false;
+		unstable++;
+		moved = arg;
+	}
+	if (unstable == 0) return true;
+	// 定数でない実引数は、置き換えるその1つだけ
+	if (unstable != 1 || non_const != 1 || callee->inline_has_call) return false;
+	return !callee->inline_reads_mem || !has_side_effect(moved);
+}
+
+/**
+ * @brief 式を複製して仮引数を実引数に置き換える. 値の変わらない実引数は読むたびに複製する
+ *
+ */
+static Node *substitute(Node *node, Function *callee, Node **args) {
+	if (node->kind == ND_LVAR) {
+		int i = param_index(callee, node->var);
+		if (args[i]->kind == ND_NUM || args[i]->kind == ND_LVAR || args[i]->kind == ND_GVAR) {
+			Node *res = copy_node(args[i], &node_arena);
+			res->next = NULL;
+			return res;
+		}
+		args[i]->next = NULL;
+		return args[i];
+	}
+	Node *res = copy_node(node, &node_arena);
+	res->next = NULL;
+	switch (node->kind)
+	{
+	case ND_NUM:
+	case ND_GVAR:
+		return res;
+	case ND_FUNCALL:
+		{
+			Node **now = &res->args;
+			for (Node *arg = node->args; arg; arg = arg->next) {
+				*now = substitute(arg, callee, args);
+				now = &(*now)->next;
+			}
+			return res;
+		}
+	default:
+		res->lhs = node->lhs ? substitute(node->lhs, callee, args) : NULL;
+		res->rhs = node->rhs ? substitute(node->rhs, callee, args) : NULL;
+		return res;
+	}
+}
+
+/**
+ * @brief funcの中の関数呼び出しのうち、先に定義された小さな関数の呼び出しを式に置き換える.
+ * 実引数の中の呼び出しを先に展開する. 置き換えた式の中はもう一度展開しない.
+ * fold_functionの前に呼べば、定数の実引数がそのまま畳み込まれる
+ *
+ * @param func
+ */
+void inline_calls(Function *func) {
+	if (!inline_enabled) return;
+	frame_len = 0;
+	for (Node **now = &func->stmt; *now; now = &(*now)->next) push_slot(now);
+	while (frame_len > 0) {
+		InlineFrame frame = frames[--frame_len];
+		Node *node = *frame.slot;
+		if (!frame.expanded) {
+			push_frame(frame.slot, true);
+			push_children(node);
+			continue;
+		}
+		if (node->kind != ND_FUNCALL) continue;
+		Function *callee = find_inline(node->func_id);
+		if (callee == NULL || !can_expand(node, func, callee)) continue;
+		Node *args[MAX_ARGS];
+		int i = 0;
+		for (Node *arg = node->args; arg; arg = arg->next) args[i++] = arg;
+		Node *res = substitute(callee->inline_expr, callee, args);
+		// 並びの途中のノードを置き換えても、後ろとのつながりは保つ
+		res->next = node->next;
+		*frame.slot = res;
+	}
+}
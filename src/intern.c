@@ -0,0 +1,98 @@
+/**
+ * @file intern.c
+ * @author Takamasa Naruse
+ * @brief identifier interning
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "SverigeCC.h"
+
+#define INTERN_INIT_CAP 256
+
+typedef struct {
+	char *name;
+	int len;
+	unsigned hash;
+} InternEntry;
+
+// idで引く識別子の本体
+static InternEntry *entries;
+static int entry_count;
+static int entry_cap;
+
+// (name, len)からidを引く開番地法の表. 値はid + 1で、0は空き
+static int *table;
+static int table_cap;
+
+static unsigned hash_slice(char *name, int len) {
+	// FNV-1a
+	unsigned h = 2166136261u;
+	for (int i = 0; i < len; i++) {
+		h ^= (unsigned char)name[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static int *probe(char *name, int len, unsigned hash) {
+	unsigned mask = table_cap - 1;
+	for (unsigned i = hash & mask; ; i = (i + 1) & mask) {
+		int id = table[i] - 1;
+		if (id < 0) return &table[i];
+		InternEntry *e = &entries[id];
+		if (e->hash == hash && e->len == len && memcmp(e->name, name, len) == 0) return &table[i];
+	}
+}
+
+static void grow(void) {
+	free(table);
+	table_cap = table_cap ? table_cap * 2 : INTERN_INIT_CAP;
+	table = calloc(table_cap, sizeof(int));
+	if (table == NULL) error("out of memory (intern)\n");
+	for (int id = 0; id < entry_count; id++) {
+		InternEntry *e = &entries[id];
+		*probe(e->name, e->len, e->hash) = id + 1;
+	}
+}
+
+/**
+ * @brief 識別子を登録して番号を返す. 同じ綴りには常に同じ番号を返す
+ *
+ * @param name 終端されていなくてよい
+ * @param len
+ * @return int
+ */
+int intern(char *name, int len) {
+	if ((entry_count + 1) * 2 > table_cap) grow();
+	unsigned hash = hash_slice(name, len);
+	int *slot = probe(name, len, hash);
+	if (*slot) return *slot - 1;
+
+	if (entry_count == entry_cap) {
+		entry_cap = entry_cap ? entry_cap * 2 : INTERN_INIT_CAP;
+		entries = realloc(entries, entry_cap * sizeof(InternEntry));
+		if (entries == NULL) error("out of memory (intern)\n");
+	}
+	char *copy = arena_alloc(&ident_arena, len + 1);
+	memcpy(copy, name, len);
+	InternEntry *e = &entries[entry_count];
+	e->name = copy;
+	e->len = len;
+	e->hash = hash;
+	*slot = entry_count + 1;
+	return entry_count++;
+}
+
+/**
+ * @brief 番号から'\0'終端された識別子を返す. ラベルやシンボル名にそのまま使える
+ *
+ * @param id
+ * @return char*
+ */
+char *intern_name(int id) {
+	return entries[id].name;
+}
@@ -0,0 +1,902 @@
+/**
+ * @file ir.c
+ * @author Takamasa Naruse
+ * @brief abstract syntax tree -> three-address IR (basic blocks and CFG)
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "SverigeCC.h"
+
+bool dump_ir;
+
+// 作っている途中の関数と、命令を追加しているブロック
+static IRFunc *cur_fn;
+static BasicBlock *cur_bb;
+// 出力順で最後のブロック
+static BasicBlock *last_bb;
+// 自分自身の末尾呼び出しで飛ぶ先. 引数を受け取った直後. 末尾呼び出しにしないならNULL
+static BasicBlock *self_entry;
+
+////////////////////////////////////////////////////////////////////////////
+// instruction info
+////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+	char *name;
+	// dst, a, bを使うか
+	bool dst;
+	bool a;
+	bool b;
+} IRInfo;
+
+static IRInfo ir_info[] = {
+	[IR_IMM] = {"imm", true, false, false},
+	[IR_MOV] = {"mov", true, true, false},
+	[IR_ADD] = {"add", true, true, true},
+	[IR_SUB] = {"sub", true, true, true},
+	[IR_MUL] = {"mul", true, true, true},
+	[IR_DIV] = {"div", true, true, true},
+	[IR_EQ] = {"eq", true, true, true},
+	[IR_NE] = {"ne", true, true, true},
+	[IR_LT] = {"lt", true, true, true},
+	[IR_LE] = {"le", true, true, true},
+	[IR_SHL] = {"shl", true, true, false},
+	[IR_SAR] = {"sar", true, true, false},
+	[IR_SHR] = {"shr", true, true, false},
+	[IR_MULHI] = {"mulhi", true, true, true},
+	[IR_LEA] = {"lea", true, true, true},
+	[IR_LADDR] = {"laddr", true, false, false},
+	[IR_GADDR] = {"gaddr", true, false, false},
+	[IR_LOAD] = {"load", true, true, false},
+	[IR_STORE] = {"store", false, true, true},
+	[IR_PARAM] = {"param", true, false, false},
+	[IR_CALL] = {"call", true, false, false},
+	[IR_JMP] = {"jmp", false, false, false},
+	[IR_BR] = {"br", false, true, false},
+	[IR_BEQ] = {"beq", false, true, true},
+	[IR_BNE] = {"bne", false, true, true},
+	[IR_BLT] = {"blt", false, true, true},
+	[IR_BLE] = {"ble", false, true, true},
+	[IR_RET] = {"ret", false, true, false},
+	[IR_TAILCALL] = {"tailcall", false, false, false},
+};
+
+bool ir_is_terminator(IRKind kind) {
+	return kind == IR_JMP || kind == IR_RET || kind == IR_TAILCALL || ir_is_cond_branch(kind);
+}
+
+// then, elsの2方向に分かれる分岐か
+bool ir_is_cond_branch(IRKind kind) {
+	return kind == IR_BR || kind == IR_BEQ || kind == IR_BNE || kind == IR_BLT || kind == IR_BLE;
+}
+
+/**
+ * @brief bbの後続ブロックをsuccsに入れて、その数を返す
+ *
+ * @param bb
+ * @param succs 2要素以上
+ * @return int
+ */
+int ir_succs(BasicBlock *bb, BasicBlock **succs) {
+	IRInsn *tail = bb->tail;
+	if (tail == NULL) return 0;
+	if (tail->kind == IR_JMP) {
+		succs[0] = tail->then;
+		return 1;
+	}
+	if (ir_is_cond_branch(tail->kind)) {
+		succs[0] = tail->then;
+		succs[1] = tail->els;
+		return 2;
+	}
+	return 0;
+}
+
+/**
+ * @brief insnが読む仮想レジスタをusesに入れて、その数を返す
+ *
+ * @param insn
+ * @param uses MAX_ARGS要素以上
+ * @return int
+ */
+int ir_uses(IRInsn *insn, int *uses) {
+	if (insn->kind == IR_CALL || insn->kind == IR_TAILCALL) {
+		for (int i = 0; i < insn->arg_count; i++) uses[i] = insn->args[i];
+		return insn->arg_count;
+	}
+	int n = 0;
+	if (ir_info[insn->kind].a) uses[n++] = insn->a;
+	if (ir_info[insn->kind].b) uses[n++] = insn->b;
+	return n;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// builder
+////////////////////////////////////////////////////////////////////////////
+
+static BasicBlock *new_block(void) {
+	BasicBlock *bb = arena_alloc(&node_arena, sizeof(BasicBlock));
+	bb->id = cur_fn->block_count++;
+	return bb;
+}
+
+static bool is_terminated(BasicBlock *bb) {
+	return bb->tail && ir_is_terminator(bb->tail->kind);
+}
+
+static int new_vreg(void) {
+	return ++cur_fn->vreg_count;
+}
+
+static IRInsn *new_insn(IRKind kind) {
+	IRInsn *insn = arena_alloc(&node_arena, sizeof(IRInsn));
+	insn->kind = kind;
+	insn->prev = cur_bb->tail;
+	if (cur_bb->tail) cur_bb->tail->next = insn;
+	else cur_bb->head = insn;
+	cur_bb->tail = insn;
+	return insn;
+}
+
+static void new_jmp(BasicBlock *to) {
+	IRInsn *insn = new_insn(IR_JMP);
+	insn->then = to;
+}
+
+// 終端していなければtoへ飛ぶ
+static void jump_to(BasicBlock *to) {
+	if (!is_terminated(cur_bb)) new_jmp(to);
+}
+
+/**
+ * @brief bbを出力順の最後につないで、以降の命令の追加先にする.
+ * 今のブロックが終端していなければbbへ落ちる
+ *
+ * @param bb
+ */
+static void start_block(BasicBlock *bb) {
+	if (cur_bb) jump_to(bb);
+	if (last_bb) last_bb->next = bb;
+	else cur_fn->entry = bb;
+	last_bb = bb;
+	cur_bb = bb;
+}
+
+static void new_br(int cond, BasicBlock *then, BasicBlock *els) {
+	IRInsn *insn = new_insn(IR_BR);
+	insn->a = cond;
+	insn->then = then;
+	insn->els = els;
+}
+
+static void new_ret(int val) {
+	IRInsn *insn = new_insn(IR_RET);
+	insn->a = val;
+	// return以降の文は到達しないブロックに入れておき、最後に捨てる
+	start_block(new_block());
+}
+
+static int new_imm(int val) {
+	IRInsn *insn = new_insn(IR_IMM);
+	insn->dst = new_vreg();
+	insn->imm = val;
+	return insn->dst;
+}
+
+static int new_binop(IRKind kind, int a, int b) {
+	IRInsn *insn = new_insn(kind);
+	insn->dst = new_vreg();
+	insn->a = a;
+	insn->b = b;
+	return insn->dst;
+}
+
+static int new_load(int addr, int size) {
+	IRInsn *insn = new_insn(IR_LOAD);
+	insn->dst = new_vreg();
+	insn->a = addr;
+	insn->size = size;
+	return insn->dst;
+}
+
+static void new_store(int addr, int val, int size) {
+	IRInsn *insn = new_insn(IR_STORE);
+	insn->a = addr;
+	insn->b = val;
+	insn->size = size;
+}
+
+static int new_laddr(int offset) {
+	IRInsn *insn = new_insn(IR_LADDR);
+	insn->dst = new_vreg();
+	insn->imm = offset;
+	return insn->dst;
+}
+
+// スカラーの読み書きの大きさ. charだけ1バイト
+static int access_size(Type *type) {
+	return type->_sizeof == 1 ? 1 : 8;
+}
+
+static int gen_expr(Node *node);
+
+/**
+ * @brief 変数のアドレスを計算する
+ *
+ * @param node
+ * @return int
+ */
+static int gen_addr(Node *node) {
+	switch (node->kind)
+	{
+	case ND_DEREF:
+		return gen_expr(node->lhs);
+	case ND_LVAR:
+		return new_laddr(node->var->offset);
+	case ND_GVAR:
+		{
+			IRInsn *insn = new_insn(IR_GADDR);
+			insn->dst = new_vreg();
+			insn->name = node->var->name;
+			return insn->dst;
+		}
+	default:
+		error("代入の左辺値が変数ではありません\n");
+		return 0;
+	}
+}
+
+static bool is_binary(Node *node) {
+	switch (node->kind)
+	{
+	case ND_ADD:
+	case ND_PTR_ADD:
+	case ND_SUB:
+	case ND_PTR_SUB:
+	case ND_PTR_DIFF:
+	case ND_MUL:
+	case ND_DIV:
+	case ND_EQ:
+	case ND_NEQ:
+	case ND_LE:
+	case ND_LT:
+	case ND_GE:
+	case ND_GT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// 比較演算の記号のひっくり返し. ND_GE, ND_GTは右から先に評価して、ND_LE, ND_LTにする
+static Node *first_operand(Node *node) {
+	return node->kind == ND_GE || node->kind == ND_GT ? node->rhs : node->lhs;
+}
+
+static Node *second_operand(Node *node) {
+	return node->kind == ND_GE || node->kind == ND_GT ? node->lhs : node->rhs;
+}
+
+/**
+ * @brief 二項演算を1つ出力する. aは先に評価した側、bは後に評価した側の値
+ *
+ */
+static int binary_op(Node *node, int a, int b) {
+	switch (node->kind)
+	{
+	case ND_ADD:
+		return new_binop(IR_ADD, a, b);
+	case ND_SUB:
+		return new_binop(IR_SUB, a, b);
+	case ND_MUL:
+		return new_binop(IR_MUL, a, b);
+	case ND_DIV:
+		return new_binop(IR_DIV, a, b);
+	case ND_PTR_ADD:
+		return new_binop(IR_ADD, a, new_binop(IR_MUL, b, new_imm(node->lhs->type->ptr_to->_sizeof)));
+	case ND_PTR_SUB:
+		return new_binop(IR_SUB, a, new_binop(IR_MUL, b, new_imm(node->lhs->type->ptr_to->_sizeof)));
+	case ND_PTR_DIFF:
+		return new_binop(IR_DIV, new_binop(IR_SUB, a, b), new_imm(node->lhs->type->ptr_to->_sizeof));
+	case ND_EQ:
+		return new_binop(IR_EQ, a, b);
+	case ND_NEQ:
+		return new_binop(IR_NE, a, b);
+	case ND_LT:
+	case ND_GT:
+		return new_binop(IR_LT, a, b);
+	case ND_LE:
+	case ND_GE:
+		return new_binop(IR_LE, a, b);
+	default:
+		error("何その式(binary_op)\n");
+		return 0;
+	}
+}
+
+// 1+2+3+...のように左に深く伸びた式で再帰しないよう、先に評価する側の枝を積んでおくスタック
+static Node **spine;
+static int spine_len;
+static int spine_cap;
+
+/**
+ * @brief 二項演算の木を変換する. 先に評価する側の枝をたどる間は再帰せず、
+ * 明示的なスタックに積んでから葉の側から順に演算を出力する
+ *
+ * @param node
+ * @return int
+ */
+static int gen_binary(Node *node) {
+	int base = spine_len;
+	for (; is_binary(node); node = first_operand(node)) {
+		if (spine_len == spine_cap) {
+			spine_cap = spine_cap ? spine_cap * 2 : 256;
+			spine = realloc(spine, spine_cap * sizeof(Node *));
+			if (spine == NULL) error("out of memory (ir)\n");
+		}
+		spine[spine_len++] = node;
+	}
+	int val = gen_expr(node);
+	while (spine_len > base) {
+		Node *now = spine[--spine_len];
+		val = binary_op(now, val, gen_expr(second_operand(now)));
+	}
+	return val;
+}
+
+static int *gen_args(Node *node) {
+	if (node->arg_count > MAX_ARGS) error("%s: 引数は%d個までです\n", node->funcname, MAX_ARGS);
+	int *args = arena_alloc(&node_arena, sizeof(int) * MAX_ARGS);
+	int i = 0;
+	for (Node *now = node->args; now; now = now->next) args[i++] = gen_expr(now);
+	return args;
+}
+
+static int gen_funcall(Node *node) {
+	int *args = gen_args(node);
+	IRInsn *insn = new_insn(IR_CALL);
+	insn->dst = new_vreg();
+	insn->name = node->funcname;
+	insn->args = args;
+	insn->arg_count = node->arg_count;
+	return insn->dst;
+}
+
+/**
+ * @brief 式の値を計算して、値の入った仮想レジスタを返す
+ *
+ * @param node
+ * @return int
+ */
+static int gen_expr(Node *node) {
+	switch (node->kind)
+	{
+	case ND_NUM:
+		return new_imm(node->val);
+	case ND_LVAR:
+		if (node->var->vreg) return node->var->vreg;
+		// fall through
+	case ND_GVAR:
+		{
+			int addr = gen_addr(node);
+			// 配列は先頭のアドレスがそのまま値になる
+			if (node->type->ty == TP_ARRAY) return addr;
+			return new_load(addr, access_size(node->type));
+		}
+	case ND_ASSIGN:
+		if (node->lhs->kind == ND_LVAR && node->lhs->var->vreg) {
+			int val = gen_expr(node->rhs);
+			IRInsn *insn = new_insn(IR_MOV);
+			insn->dst = node->lhs->var->vreg;
+			insn->a = val;
+			return val;
+		}
+		{
+			int addr = gen_addr(node->lhs);
+			int val = gen_expr(node->rhs);
+			new_store(addr, val, access_size(node->type));
+			return val;
+		}
+	case ND_ADDR:
+		return gen_addr(node->lhs);
+	case ND_DEREF:
+		{
+			int addr = gen_expr(node->lhs);
+			if (node->type->ty == TP_ARRAY) return addr;
+			return new_load(addr, access_size(node->type));
+		}
+	case ND_FUNCALL:
+		return gen_funcall(node);
+	default:
+		return gen_binary(node);
+	}
+}
+
+/**
+ * @brief 条件式を評価してthenかelsへ分岐する. 比較演算なら値を作らず、比べてそのまま分岐する
+ *
+ */
+static void gen_cond(Node *node, BasicBlock *then, BasicBlock *els) {
+	IRKind kind;
+	switch (node->kind)
+	{
+	case ND_EQ:
+		kind = IR_BEQ;
+		break;
+	case ND_NEQ:
+		kind = IR_BNE;
+		break;
+	case ND_LT:
+	case ND_GT:
+		kind = IR_BLT;
+		break;
+	case ND_LE:
+	case ND_GE:
+		kind = IR_BLE;
+		break;
+	default:
+		new_br(gen_expr(node), then, els);
+		return;
+	}
+	int a = gen_expr(first_operand(node));
+	int b = gen_expr(second_operand(node));
+	IRInsn *insn = new_insn(kind);
+	insn->a = a;
+	insn->b = b;
+	insn->then = then;
+	insn->els = els;
+}
+
+static void gen_stmt(Node *node);
+
+static void gen_if(Node *node) {
+	BasicBlock *then = new_block();
+	BasicBlock *end = new_block();
+	BasicBlock *els = node->else_stmt ? new_block() : end;
+	gen_cond(node->condition, then, els);
+	start_block(then);
+	if (node->then_stmt) gen_stmt(node->then_stmt);
+	if (node->else_stmt) {
+		jump_to(end);
+		start_block(els);
+		gen_stmt(node->else_stmt);
+	}
+	start_block(end);
+}
+
+/**
+ * @brief ループは条件を入口と末尾の2か所で評価する形にする.
+ * 入口で一度だけ条件を調べて、あとは本体の最後で条件が成り立つ間だけ先頭へ戻る.
+ * 1周ごとの分岐が条件分岐1つだけになる
+ *
+ */
+static void gen_while(Node *node) {
+	BasicBlock *body = new_block();
+	BasicBlock *end = new_block();
+	body->loop_head = true;
+	gen_cond(node->lhs, body, end);
+	start_block(body);
+	if (node->rhs) gen_stmt(node->rhs);
+	gen_cond(node->lhs, body, end);
+	start_block(end);
+}
+
+static void gen_for(Node *node) {
+	BasicBlock *body = new_block();
+	BasicBlock *end = new_block();
+	body->loop_head = true;
+	if (node->init) gen_expr(node->init);
+	if (node->condition) gen_cond(node->condition, body, end);
+	start_block(body);
+	if (node->then_stmt) gen_stmt(node->then_stmt);
+	if (node->loop) gen_expr(node->loop);
+	if (node->condition) gen_cond(node->condition, body, end);
+	else jump_to(body);
+	start_block(end);
+}
+
+/**
+ * @brief return f(...)を、呼び出した後に戻ってこない形にする.
+ * 自分自身なら引数を仮引数に移して先頭へ飛ぶループにし、それ以外は自分のフレームを片付けてから飛ぶ
+ *
+ */
+static void gen_tail_call(Node *node) {
+	int *args = gen_args(node);
+	Function *func = cur_fn->func;
+	if (node->funcname != func->name || node->arg_count != func->arg_count) {
+		IRInsn *insn = new_insn(IR_TAILCALL);
+		insn->name = node->funcname;
+		insn->args = args;
+		insn->arg_count = node->arg_count;
+		start_block(new_block());
+		return;
+	}
+
+	// f(b, a)のように他の仮引数を渡すときは、仮引数を書き換える前に値を写しておく
+	Var *params[MAX_ARGS];
+	int i = 0;
+	for (Node *arg = func->arg; arg; arg = arg->next) params[i++] = arg->var;
+	for (i = 0; i < func->arg_count; i++) {
+		for (int j = 0; j < func->arg_count; j++) {
+			if (j == i || params[j]->vreg == 0 || args[i] != params[j]->vreg) continue;
+			IRInsn *insn = new_insn(IR_MOV);
+			insn->dst = new_vreg();
+			insn->a = args[i];
+			args[i] = insn->dst;
+			break;
+		}
+	}
+	for (i = 0; i < func->arg_count; i++) {
+		if (params[i]->vreg == 0) {
+			new_store(new_laddr(params[i]->offset), args[i], access_size(params[i]->type));
+		} else if (args[i] != params[i]->vreg) {
+			IRInsn *insn = new_insn(IR_MOV);
+			insn->dst = params[i]->vreg;
+			insn->a = args[i];
+		}
+	}
+	self_entry->loop_head = true;
+	jump_to(self_entry);
+	start_block(new_block());
+}
+
+static void gen_stmt(Node *node) {
+	switch (node->kind)
+	{
+	case ND_RETURN:
+		if (self_entry && node->lhs->kind == ND_FUNCALL) gen_tail_call(node->lhs);
+		else new_ret(gen_expr(node->lhs));
+		return;
+	case ND_IF:
+		gen_if(node);
+		return;
+	case ND_WHILE:
+		gen_while(node);
+		return;
+	case ND_FOR:
+		gen_for(node);
+		return;
+	case ND_BLOCK:
+		for (Node *now = node->body; now; now = now->next) gen_stmt(now);
+		return;
+	case ND_NULL:
+		return;
+	default:
+		// 式文. 値は捨てる
+		gen_expr(node);
+		return;
+	}
+}
+
+/**
+ * @brief entryから到達できないブロックを出力順のリストから外して、番号を振り直す
+ *
+ */
+static void remove_unreachable(IRFunc *ir) {
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) bb->mark = 0;
+	BasicBlock **work = malloc(sizeof(BasicBlock *) * ir->block_count);
+	if (work == NULL) error("out of memory (ir)\n");
+	int len = 0;
+	work[len++] = ir->entry;
+	ir->entry->mark = 1;
+	while (len > 0) {
+		BasicBlock *succs[2];
+		int n = ir_succs(work[--len], succs);
+		for (int i = 0; i < n; i++) {
+			if (succs[i]->mark) continue;
+			succs[i]->mark = 1;
+			work[len++] = succs[i];
+		}
+	}
+	free(work);
+
+	BasicBlock **now = &(ir->entry);
+	ir->block_count = 0;
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) {
+		if (!bb->mark) continue;
+		bb->id = ir->block_count++;
+		*now = bb;
+		now = &(bb->next);
+	}
+	*now = NULL;
+}
+
+/**
+ * @brief ローカル変数を仮想レジスタに載せてよいか.
+ * アドレスを取る変数や配列があると、隣の変数をポインタ経由で読み書きされうるので、
+ * その関数では全部の変数をメモリに置く
+ *
+ */
+static bool can_promote(Function *func) {
+	if (func->addr_taken) return false;
+	for (Var *var = func->local; var->next; var = var->next) {
+		if (var->type->ty == TP_ARRAY) return false;
+	}
+	return true;
+}
+
+static bool is_param(Function *func, Var *var) {
+	for (Node *arg = func->arg; arg; arg = arg->next) {
+		if (arg->var == var) return true;
+	}
+	return false;
+}
+
+/**
+ * @brief 関数の抽象構文木を中間表現にする. 中間表現はnode_arenaに置くので、関数ごとに捨てる
+ *
+ * @param func
+ * @return IRFunc*
+ */
+IRFunc *ir_build(Function *func) {
+	cur_fn = arena_alloc(&node_arena, sizeof(IRFunc));
+	cur_fn->name = func->name;
+	cur_fn->func = func;
+	cur_fn->local_size = (func->total_offset + 7) & ~7;
+	cur_bb = last_bb = NULL;
+	start_block(new_block());
+
+	bool promote = can_promote(func);
+	for (Var *var = func->local; var->next; var = var->next) {
+		var->vreg = promote && var->type->_sizeof == 8 ? new_vreg() : 0;
+	}
+
+	// 引数はレジスタで渡されるので、変数の仮想レジスタかローカル変数の領域に移しておく
+	int i = 0;
+	for (Node *arg = func->arg; arg; arg = arg->next, i++) {
+		if (i >= MAX_ARGS) error("%s: 引数は%d個までです\n", func->name, MAX_ARGS);
+		IRInsn *insn = new_insn(IR_PARAM);
+		insn->imm = i;
+		if (arg->var->vreg) insn->dst = arg->var->vreg;
+		else {
+			insn->dst = new_vreg();
+			new_store(new_laddr(arg->var->offset), insn->dst, access_size(arg->type));
+		}
+	}
+	// 仮想レジスタに載せた変数は、どこから読んでも定義済みになるよう0で初期化する
+	for (Var *var = func->local; var->next; var = var->next) {
+		if (var->vreg == 0 || is_param(func, var)) continue;
+		IRInsn *insn = new_insn(IR_IMM);
+		insn->dst = var->vreg;
+		insn->imm = 0;
+	}
+	// 末尾呼び出しで片付けるフレームや、先頭からやり直す関数のフレームを指すポインタがあってはいけないので、
+	// ローカル変数のアドレスを取らない関数に限る
+	self_entry = NULL;
+	if (opt_level >= 1 && promote) {
+		self_entry = new_block();
+		start_block(self_entry);
+	}
+
+	for (Node *now = func->stmt; now; now = now->next) gen_stmt(now);
+	// returnせずに最後まで来たら0を返す
+	if (!is_terminated(cur_bb)) new_ret(new_imm(0));
+
+	IRFunc *ir = cur_fn;
+	remove_unreachable(ir);
+	ir_cfg(ir);
+	cur_fn = NULL;
+	cur_bb = last_bb = self_entry = NULL;
+	return ir;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// editing (最適化のパス用)
+////////////////////////////////////////////////////////////////////////////
+
+int ir_new_vreg(IRFunc *ir) {
+	return ++ir->vreg_count;
+}
+
+// 出力順のリストにはつながない. つなぐのは呼んだ側
+BasicBlock *ir_new_block(IRFunc *ir) {
+	BasicBlock *bb = arena_alloc(&node_arena, sizeof(BasicBlock));
+	bb->id = ir->block_count++;
+	return bb;
+}
+
+/**
+ * @brief bbのposの直前に命令を挿入する. posがNULLなら最後に追加する
+ *
+ * @return IRInsn* 挿入した命令
+ */
+IRInsn *ir_insert_before(BasicBlock *bb, IRInsn *pos, IRKind kind) {
+	IRInsn *insn = arena_alloc(&node_arena, sizeof(IRInsn));
+	insn->kind = kind;
+	insn->next = pos;
+	insn->prev = pos ? pos->prev : bb->tail;
+	if (insn->prev) insn->prev->next = insn;
+	else bb->head = insn;
+	if (pos) pos->prev = insn;
+	else bb->tail = insn;
+	return insn;
+}
+
+/**
+ * @brief insnが読む仮想レジスタvをmap[v]に置き換える. map[v]が0なら置き換えない
+ *
+ */
+void ir_rename_uses(IRInsn *insn, int *map) {
+	if (insn->kind == IR_CALL || insn->kind == IR_TAILCALL) {
+		for (int i = 0; i < insn->arg_count; i++) {
+			if (map[insn->args[i]]) insn->args[i] = map[insn->args[i]];
+		}
+		return;
+	}
+	if (ir_info[insn->kind].a && map[insn->a]) insn->a = map[insn->a];
+	if (ir_info[insn->kind].b && map[insn->b]) insn->b = map[insn->b];
+}
+
+void ir_remove(BasicBlock *bb, IRInsn *insn) {
+	if (insn->prev) insn->prev->next = insn->next;
+	else bb->head = insn->next;
+	if (insn->next) insn->next->prev = insn->prev;
+	else bb->tail = insn->prev;
+	insn->prev = insn->next = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// control flow graph
+////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief 各ブロックの前任ブロックを計算し直す. ブロックや分岐を書き換えたパスの後に呼ぶ
+ *
+ * @param ir
+ */
+void ir_cfg(IRFunc *ir) {
+	BasicBlock *succs[2];
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) bb->pred_count = 0;
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) {
+		int n = ir_succs(bb, succs);
+		for (int i = 0; i < n; i++) succs[i]->pred_count++;
+	}
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) {
+		bb->preds = arena_alloc(&node_arena, sizeof(BasicBlock *) * bb->pred_count);
+		bb->pred_count = 0;
+	}
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) {
+		int n = ir_succs(bb, succs);
+		for (int i = 0; i < n; i++) succs[i]->preds[succs[i]->pred_count++] = bb;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////
+// verifier
+////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief 中間表現が正しい形をしているか調べる. おかしければerrorで止める
+ *
+ * @param ir
+ */
+void ir_verify(IRFunc *ir) {
+	if (ir->entry == NULL) error("ir_verify: %s: no entry block\n", ir->name);
+	// 1: この関数のブロック
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) bb->mark = 1;
+	// 各仮想レジスタがどこかで定義されているか
+	bool *defined = calloc(ir->vreg_count + 1, sizeof(bool));
+	if (defined == NULL) error("out of memory (ir)\n");
+
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) {
+		if (bb->head == NULL) error("ir_verify: %s: bb%d is empty\n", ir->name, bb->id);
+		if (!ir_is_terminator(bb->tail->kind)) error("ir_verify: %s: bb%d has no terminator\n", ir->name, bb->id);
+		for (IRInsn *insn = bb->head; insn; insn = insn->next) {
+			if (insn->next == NULL && insn != bb->tail) error("ir_verify: %s: bb%d: broken list\n", ir->name, bb->id);
+			if (insn->next && insn->next->prev != insn) error("ir_verify: %s: bb%d: broken list\n", ir->name, bb->id);
+			if (insn != bb->tail && ir_is_terminator(insn->kind)) {
+				error("ir_verify: %s: bb%d: %s in the middle of a block\n", ir->name, bb->id, ir_info[insn->kind].name);
+			}
+			if (ir_info[insn->kind].dst) {
+				if (insn->dst <= 0 || insn->dst > ir->vreg_count) error("ir_verify: %s: bb%d: bad dst v%d\n", ir->name, bb->id, insn->dst);
+				defined[insn->dst] = true;
+			}
+			if ((insn->kind == IR_LOAD || insn->kind == IR_STORE) && insn->size != 1 && insn->size != 8) {
+				error("ir_verify: %s: bb%d: bad access size %d\n", ir->name, bb->id, insn->size);
+			}
+			if ((insn->kind == IR_CALL || insn->kind == IR_TAILCALL) && insn->arg_count > MAX_ARGS) error("ir_verify: %s: bb%d: too many args\n", ir->name, bb->id);
+			if (insn->kind == IR_PARAM && (insn->imm < 0 || insn->imm >= MAX_ARGS)) error("ir_verify: %s: bb%d: bad param\n", ir->name, bb->id);
+			if ((insn->kind == IR_SHL || insn->kind == IR_SAR || insn->kind == IR_SHR) && (insn->imm < 0 || insn->imm > 63)) {
+				error("ir_verify: %s: bb%d: bad shift %ld\n", ir->name, bb->id, insn->imm);
+			}
+			if (insn->kind == IR_LEA && insn->imm != 1 && insn->imm != 2 && insn->imm != 4 && insn->imm != 8) {
+				error("ir_verify: %s: bb%d: bad scale %ld\n", ir->name, bb->id, insn->imm);
+			}
+		}
+		BasicBlock *succs[2];
+		int n = ir_succs(bb, succs);
+		for (int i = 0; i < n; i++) {
+			if (succs[i] == NULL || succs[i]->mark != 1) error("ir_verify: %s: bb%d jumps out of the function\n", ir->name, bb->id);
+		}
+	}
+
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) {
+		for (IRInsn *insn = bb->head; insn; insn = insn->next) {
+			int uses[MAX_ARGS];
+			int n = ir_uses(insn, uses);
+			for (int i = 0; i < n; i++) {
+				if (uses[i] <= 0 || uses[i] > ir->vreg_count || !defined[uses[i]]) {
+					error("ir_verify: %s: bb%d: v%d is used but never defined\n", ir->name, bb->id, uses[i]);
+				}
+			}
+		}
+		bb->mark = 0;
+	}
+	free(defined);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// dump
+////////////////////////////////////////////////////////////////////////////
+
+static void dump_insn(IRInsn *insn) {
+	fprintf(stderr, "  ");
+	if (ir_info[insn->kind].dst) fprintf(stderr, "v%d = ", insn->dst);
+	fprintf(stderr, "%s", ir_info[insn->kind].name);
+	if (insn->kind == IR_LOAD || insn->kind == IR_STORE) fprintf(stderr, "%d", insn->size);
+	switch (insn->kind)
+	{
+	case IR_IMM:
+	case IR_LADDR:
+	case IR_PARAM:
+		fprintf(stderr, " %ld", insn->imm);
+		break;
+	case IR_SHL:
+	case IR_SAR:
+	case IR_SHR:
+		fprintf(stderr, " v%d, %ld", insn->a, insn->imm);
+		break;
+	case IR_LEA:
+		fprintf(stderr, " v%d, v%d, %ld", insn->a, insn->b, insn->imm);
+		break;
+	case IR_GADDR:
+		fprintf(stderr, " %s", insn->name);
+		break;
+	case IR_CALL:
+	case IR_TAILCALL:
+		fprintf(stderr, " %s(", insn->name);
+		for (int i = 0; i < insn->arg_count; i++) fprintf(stderr, "%sv%d", i ? ", " : "", insn->args[i]);
+		fprintf(stderr, ")");
+		break;
+	case IR_JMP:
+		fprintf(stderr, " bb%d", insn->then->id);
+		break;
+	case IR_BR:
+		fprintf(stderr, " v%d, bb%d, bb%d", insn->a, insn->then->id, insn->els->id);
+		break;
+	case IR_BEQ:
+	case IR_BNE:
+	case IR_BLT:
+	case IR_BLE:
+		fprintf(stderr, " v%d, v%d, bb%d, bb%d", insn->a, insn->b, insn->then->id, insn->els->id);
+		break;
+	default:
+		if (ir_info[insn->kind].a) fprintf(stderr, " v%d", insn->a);
+		if (ir_info[insn->kind].b) fprintf(stderr, ", v%d", insn->b);
+		break;
+	}
+	fprintf(stderr, "\n");
+}
+
+/**
+ * @brief 中間表現を読める形でエラー出力に書き出す(--dump-irのとき)
+ *
+ * @param ir
+ */
+void ir_dump(IRFunc *ir) {
+	fprintf(stderr, "func %s (%d vregs, %d bytes of locals)\n", ir->name, ir->vreg_count, ir->local_size);
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) {
+		fprintf(stderr, "bb%d:", bb->id);
+		if (bb->pred_count) {
+			fprintf(stderr, " ; preds");
+			for (int i = 0; i < bb->pred_count; i++) fprintf(stderr, " bb%d", bb->preds[i]->id);
+		}
+		if (bb->loop_head) fprintf(stderr, " ; loop");
+		fprintf(stderr, "\n");
+		for (IRInsn *insn = bb->head; insn; insn = insn->next) dump_insn(insn);
+	}
+}
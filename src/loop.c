@@ -0,0 +1,514 @@
+/**
+ * @file loop.c
+ * @author Takamasa Naruse
+ * @brief loop-invariant code motion and induction variable strength reduction on the IR (-O1)
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "SverigeCC.h"
+
+// 1つのループで、誘導変数から作り直す式の数の上限. 増やすたびにループ中ずっと生きるレジスタが1つ増える
+#define MAX_DERIVED 4
+
+// 各仮想レジスタの定義の数、使用の数、定義した命令(定義が1つのときだけ意味がある).
+// 数えた後に作った仮想レジスタ(counted より大きい番号)は載っていない
+static int counted;
+static int *def_count;
+static int *use_count;
+static IRInsn **def_insn;
+// 今見ているループの中での定義の数
+static int *loop_defs;
+// 仮想レジスタの置き換え先. 0なら置き換えない
+static int *alias;
+
+// 今見ているループのブロック. in_loopはブロックの番号で引く
+static bool *in_loop;
+static BasicBlock **body;
+static int body_len;
+
+static void *alloc_zero(size_t count, size_t size) {
+	void *res = calloc(count, size);
+	if (res == NULL) error("out of memory (loop)\n");
+	return res;
+}
+
+static void count_defs_uses(IRFunc *ir) {
+	counted = ir->vreg_count;
+	int nv = counted + 1;
+	free(def_count);
+	free(use_count);
+	free(def_insn);
+	free(loop_defs);
+	free(alias);
+	def_count = alloc_zero(nv, sizeof(int));
+	use_count = alloc_zero(nv, sizeof(int));
+	def_insn = alloc_zero(nv, sizeof(IRInsn *));
+	loop_defs = alloc_zero(nv, sizeof(int));
+	alias = alloc_zero(nv, sizeof(int));
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) {
+		for (IRInsn *insn = bb->head; insn; insn = insn->next) {
+			int uses[MAX_ARGS];
+			int n = ir_uses(insn, uses);
+			for (int i = 0; i < n; i++) use_count[uses[i]]++;
+			if (insn->dst == 0) continue;
+			def_count[insn->dst]++;
+			def_insn[insn->dst] = insn;
+			if (in_loop[bb->id]) loop_defs[insn->dst]++;
+		}
+	}
+}
+
+// vregが定数なら*valに入れる
+static bool const_of(int vreg, long *val) {
+	if (vreg > counted || def_count[vreg] != 1 || def_insn[vreg]->kind != IR_IMM) return false;
+	*val = def_insn[vreg]->imm;
+	return true;
+}
+
+// ループの中で値が変わらない
+static bool is_invariant(int vreg) {
+	return vreg <= counted && loop_defs[vreg] == 0;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// loop
+////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief headを先頭とするループのブロックを求める. headから届き、かつhead以外を通らずにheadへ戻れるブロックの集まり.
+ * head以外の入口があればループとして扱わない
+ *
+ * @return bool ループの形をしているか
+ */
+static bool find_loop(IRFunc *ir, BasicBlock *head) {
+	// 後で前置ブロックを1つ足すので、その分も取っておく
+	int n = ir->block_count + 1;
+	bool *reach = alloc_zero(n, sizeof(bool));
+	free(in_loop);
+	in_loop = alloc_zero(n, sizeof(bool));
+	BasicBlock **work = alloc_zero(n, sizeof(BasicBlock *));
+	int len = 0;
+	work[len++] = head;
+	reach[head->id] = true;
+	while (len > 0) {
+		BasicBlock *succs[2];
+		int k = ir_succs(work[--len], succs);
+		for (int i = 0; i < k; i++) {
+			if (reach[succs[i]->id]) continue;
+			reach[succs[i]->id] = true;
+			work[len++] = succs[i];
+		}
+	}
+
+	// 後ろ向きの分岐(出力順でhead以降のブロックからheadへの分岐)の元からさかのぼる.
+	// ループは出力順でひと続きに作るので、外側のループから戻ってくる分岐は含まない
+	int *order = alloc_zero(n, sizeof(int));
+	int k = 0;
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) order[bb->id] = k++;
+	bool ok = true;
+	in_loop[head->id] = true;
+	for (int i = 0; i < head->pred_count; i++) {
+		if (order[head->preds[i]->id] >= order[head->id]) work[len++] = head->preds[i];
+	}
+	free(order);
+	if (len == 0) ok = false;
+	while (len > 0 && ok) {
+		BasicBlock *bb = work[--len];
+		if (in_loop[bb->id]) continue;
+		if (!reach[bb->id]) ok = false;
+		in_loop[bb->id] = true;
+		for (int i = 0; i < bb->pred_count; i++) work[len++] = bb->preds[i];
+	}
+	free(reach);
+	free(work);
+	if (!ok) return false;
+
+	free(body);
+	body = alloc_zero(ir->block_count, sizeof(BasicBlock *));
+	body_len = 0;
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) {
+		if (in_loop[bb->id]) body[body_len++] = bb;
+	}
+	return true;
+}
+
+/**
+ * @brief ループの外からheadへの分岐を全部受ける前置ブロックを、出力順でheadの直前に作る.
+ * ループから外に出した命令はここに置くので、ループに入るときに1度だけ実行される
+ *
+ */
+static BasicBlock *make_preheader(IRFunc *ir, BasicBlock *head) {
+	BasicBlock *pre = ir_new_block(ir);
+	ir_insert_before(pre, NULL, IR_JMP)->then = head;
+	for (int i = 0; i < head->pred_count; i++) {
+		IRInsn *br = head->preds[i]->tail;
+		if (in_loop[head->preds[i]->id]) continue;
+		if (br->then == head) br->then = pre;
+		if (br->els == head) br->els = pre;
+	}
+	BasicBlock *prev = ir->entry;
+	while (prev->next != head) prev = prev->next;
+	prev->next = pre;
+	pre->next = head;
+	ir_cfg(ir);
+	return pre;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// invariant code motion
+////////////////////////////////////////////////////////////////////////////
+
+// 副作用がなく、失敗もしない命令. 読み込みはループ中の書き込みと重なりうるので動かさない
+static bool is_pure(IRKind kind) {
+	switch (kind)
+	{
+	case IR_IMM:
+	case IR_MOV:
+	case IR_ADD:
+	case IR_SUB:
+	case IR_MUL:
+	case IR_EQ:
+	case IR_NE:
+	case IR_LT:
+	case IR_LE:
+	case IR_SHL:
+	case IR_SAR:
+	case IR_SHR:
+	case IR_MULHI:
+	case IR_LEA:
+	case IR_LADDR:
+	case IR_GADDR:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool same_value(IRInsn *x, IRInsn *y) {
+	if (x->kind != y->kind || x->a != y->a || x->b != y->b || x->imm != y->imm) return false;
+	return x->name == y->name || (x->name && y->name && strcmp(x->name, y->name) == 0);
+}
+
+// 命令をbbの終端の直前に写す
+static IRInsn *copy_to_end(BasicBlock *bb, IRInsn *insn) {
+	IRInsn *res = ir_insert_before(bb, bb->tail, insn->kind);
+	IRInsn *prev = res->prev, *next = res->next;
+	*res = *insn;
+	res->prev = prev;
+	res->next = next;
+	return res;
+}
+
+/**
+ * @brief 値がループの中で変わらない命令を前置ブロックに移す. 前置ブロックに同じ値の命令があれば、そちらを使う.
+ * 移すのは結果の仮想レジスタが1度だけ定義されるもの(式の途中の値)に限る
+ *
+ */
+static void hoist(IRFunc *ir, BasicBlock *pre) {
+	bool changed = true, renamed = false;
+	while (changed) {
+		changed = false;
+		for (int b = 0; b < body_len; b++) {
+			IRInsn *next;
+			for (IRInsn *insn = body[b]->head; insn; insn = next) {
+				next = insn->next;
+				if (!is_pure(insn->kind) || def_count[insn->dst] != 1) continue;
+				int uses[MAX_ARGS];
+				int n = ir_uses(insn, uses);
+				bool invariant = true;
+				for (int i = 0; i < n; i++) invariant = invariant && is_invariant(uses[i]);
+				if (!invariant) continue;
+
+				ir_remove(body[b], insn);
+				loop_defs[insn->dst] = 0;
+				changed = true;
+				ir_rename_uses(insn, alias);
+				IRInsn *same = NULL;
+				for (IRInsn *now = pre->head; now != pre->tail && same == NULL; now = now->next) {
+					if (same_value(now, insn)) same = now;
+				}
+				if (same) {
+					alias[insn->dst] = same->dst;
+					renamed = true;
+				} else copy_to_end(pre, insn);
+			}
+		}
+	}
+	if (!renamed) return;
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) {
+		for (IRInsn *insn = bb->head; insn; insn = insn->next) ir_rename_uses(insn, alias);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////
+// induction variable
+////////////////////////////////////////////////////////////////////////////
+
+// 誘導変数の i = i + c. movは i = t, その直前で t = i + c か t = i - c.
+// 置き換えで作った p = p + c * scale もmovに入れる
+typedef struct {
+	BasicBlock *bb;
+	IRInsn *mov;
+	long step;
+} IVDef;
+
+static IVDef *iv_defs;
+static int iv_def_len;
+
+// 0: 未定, 1: ループの中の定義がすべて i = i + 定数 の形, -1: それ以外. iv_capより大きい番号は載っていない
+static int *iv_state;
+static int iv_cap;
+
+static void add_iv_def(BasicBlock *bb, IRInsn *mov, long step) {
+	iv_defs[iv_def_len].bb = bb;
+	iv_defs[iv_def_len].mov = mov;
+	iv_defs[iv_def_len].step = step;
+	iv_def_len++;
+}
+
+// ループの中の定義を調べて、基本誘導変数を求める
+static void find_ivs(void) {
+	iv_def_len = 0;
+	for (int b = 0; b < body_len; b++) {
+		for (IRInsn *insn = body[b]->head; insn; insn = insn->next) {
+			int v = insn->dst;
+			if (v == 0 || iv_state[v] < 0) continue;
+			iv_state[v] = -1;
+			IRInsn *add = insn->prev;
+			if (insn->kind != IR_MOV || add == NULL || add->dst != insn->a) continue;
+			if (def_count[add->dst] != 1 || use_count[add->dst] != 1) continue;
+			long step;
+			if (add->kind == IR_ADD) {
+				if (!((add->a == v && const_of(add->b, &step)) || (add->b == v && const_of(add->a, &step)))) continue;
+			} else if (add->kind == IR_SUB) {
+				if (add->a != v || !const_of(add->b, &step)) continue;
+				step = -step;
+			} else continue;
+			iv_state[v] = 1;
+			add_iv_def(body[b], insn, step);
+		}
+	}
+}
+
+static bool is_iv(int vreg) {
+	return vreg < iv_cap && iv_state[vreg] > 0;
+}
+
+/**
+ * @brief insnが 不変な値 + i * scale の形なら誘導変数iを返す. そうでなければ0
+ *
+ */
+static int derived_iv(IRInsn *insn, long *scale) {
+	if (insn->dst > counted || def_count[insn->dst] != 1) return 0;
+	int a = insn->a, b = insn->b;
+	long c;
+	*scale = 1;
+	switch (insn->kind)
+	{
+	case IR_LEA:
+		if (a == b && is_iv(a)) {
+			*scale = insn->imm + 1;
+			return a;
+		}
+		if (is_iv(b) && is_invariant(a)) {
+			*scale = insn->imm;
+			return b;
+		}
+		return is_iv(a) && is_invariant(b) ? a : 0;
+	case IR_ADD:
+		if (is_iv(a) && is_invariant(b)) return a;
+		return is_iv(b) && is_invariant(a) ? b : 0;
+	case IR_SUB:
+		if (is_iv(a) && is_invariant(b)) return a;
+		*scale = -1;
+		return is_iv(b) && is_invariant(a) ? b : 0;
+	case IR_SHL:
+		*scale = 1L << insn->imm;
+		return is_iv(a) ? a : 0;
+	case IR_MUL:
+		if (is_iv(a) && const_of(b, &c)) {
+			*scale = c;
+			return a;
+		}
+		if (is_iv(b) && const_of(a, &c)) {
+			*scale = c;
+			return b;
+		}
+		return 0;
+	default:
+		return 0;
+	}
+}
+
+// 掛け算の代わりになる形. 足し算だけの形は置き換えても命令が減らない
+static bool is_scaled(IRInsn *insn, int iv) {
+	if (insn->kind == IR_LEA) return insn->b == iv;
+	return insn->kind == IR_SHL || insn->kind == IR_MUL;
+}
+
+// xを同じブロックの後ろで掛け算の形に使うか. a[i+1]のi+1など
+static bool feeds_scaled(IRInsn *insn) {
+	long scale;
+	for (IRInsn *now = insn->next; now; now = now->next) {
+		if (now->a != insn->dst && now->b != insn->dst) continue;
+		// xが誘導変数だったとして調べる
+		iv_state[insn->dst] = 1;
+		bool res = derived_iv(now, &scale) == insn->dst && is_scaled(now, insn->dst);
+		iv_state[insn->dst] = 0;
+		if (res) return true;
+	}
+	return false;
+}
+
+// 前置ブロックに定数を置く. 同じ値があればそれを使う
+static int new_imm(IRFunc *ir, BasicBlock *pre, long val) {
+	for (IRInsn *now = pre->head; now != pre->tail; now = now->next) {
+		if (now->kind == IR_IMM && now->imm == val) return now->dst;
+	}
+	IRInsn *insn = ir_insert_before(pre, pre->tail, IR_IMM);
+	insn->dst = ir_new_vreg(ir);
+	insn->imm = val;
+	return insn->dst;
+}
+
+/**
+ * @brief 誘導変数iから計算するxをやめて、iが変わるたびに一緒に進める仮想レジスタpを使う.
+ * pの初期値は前置ブロックで同じ命令で計算し、iに c を足すところでpに c * scale を足す.
+ * pも誘導変数になるので、a[i*8+j]のように続く式もpから作り直せる. 同じ式がすでにpになっていればそれを使う
+ *
+ * @return int p
+ */
+static int reduce_iv(IRFunc *ir, BasicBlock *pre, BasicBlock *bb, IRInsn *insn, int iv, long scale) {
+	int p = 0;
+	for (IRInsn *now = pre->head; now != pre->tail; now = now->next) {
+		if (now->dst > counted && same_value(now, insn)) p = now->dst;
+	}
+	if (p == 0) {
+		p = ir_new_vreg(ir);
+		copy_to_end(pre, insn)->dst = p;
+		int def_len = iv_def_len;
+		for (int i = 0; i < def_len; i++) {
+			if (iv_defs[i].mov->dst != iv) continue;
+			IRInsn *add = ir_insert_before(iv_defs[i].bb, iv_defs[i].mov->next, IR_ADD);
+			add->dst = p;
+			add->a = p;
+			add->b = new_imm(ir, pre, iv_defs[i].step * scale);
+			add_iv_def(iv_defs[i].bb, add, iv_defs[i].step * scale);
+		}
+		iv_state[p] = 1;
+	}
+
+	// iが次に変わるまでの間でだけ使われるなら、xの代わりにpを直接読む
+	int x = insn->dst, uses = 0;
+	IRInsn *end;
+	for (end = insn->next; end && end->dst != iv; end = end->next) {
+		int u[MAX_ARGS];
+		int n = ir_uses(end, u);
+		for (int i = 0; i < n; i++) uses += u[i] == x;
+	}
+	if (uses == use_count[x]) {
+		alias[x] = p;
+		for (IRInsn *now = insn->next; now != end; now = now->next) ir_rename_uses(now, alias);
+		alias[x] = 0;
+		ir_remove(bb, insn);
+		return p;
+	}
+	insn->kind = IR_MOV;
+	insn->a = p;
+	insn->b = 0;
+	insn->imm = 0;
+	return p;
+}
+
+// ループの中で自分を進める以外に使われなくなったpは、進めるのをやめる
+static void remove_unused(int p) {
+	int uses = 0;
+	for (int b = 0; b < body_len; b++) {
+		for (IRInsn *insn = body[b]->head; insn; insn = insn->next) {
+			if (insn->dst == p) continue;
+			int u[MAX_ARGS];
+			int n = ir_uses(insn, u);
+			for (int i = 0; i < n; i++) uses += u[i] == p;
+		}
+	}
+	if (uses > 0) return;
+	for (int i = 0; i < iv_def_len; i++) {
+		if (iv_defs[i].mov->dst == p) ir_remove(iv_defs[i].bb, iv_defs[i].mov);
+	}
+}
+
+static void strength_reduce(IRFunc *ir, BasicBlock *pre) {
+	int insn_count = 0;
+	for (int b = 0; b < body_len; b++) {
+		for (IRInsn *insn = body[b]->head; insn; insn = insn->next) insn_count++;
+	}
+	free(iv_state);
+	free(iv_defs);
+	iv_cap = counted + 1;
+	iv_state = alloc_zero(iv_cap, sizeof(int));
+	iv_defs = alloc_zero(insn_count + 1, sizeof(IVDef));
+	find_ivs();
+	if (iv_def_len == 0) return;
+	// 置き換えで作る仮想レジスタと定義も載せられるようにしておく.
+	// 1つの式につき、pと足す定数がiの定義の数だけできる
+	int extra = MAX_DERIVED * (iv_def_len + 1);
+	iv_cap += extra;
+	iv_state = realloc(iv_state, sizeof(int) * iv_cap);
+	iv_defs = realloc(iv_defs, sizeof(IVDef) * (iv_def_len + extra));
+	free(alias);
+	alias = alloc_zero(iv_cap, sizeof(int));
+	if (iv_state == NULL || iv_defs == NULL) error("out of memory (loop)\n");
+	memset(iv_state + counted + 1, 0, sizeof(int) * extra);
+
+	int derived[MAX_DERIVED];
+	int derived_len = 0;
+	for (int b = 0; b < body_len && derived_len < MAX_DERIVED; b++) {
+		IRInsn *next;
+		for (IRInsn *insn = body[b]->head; insn && derived_len < MAX_DERIVED; insn = next) {
+			next = insn->next;
+			long scale;
+			int iv = derived_iv(insn, &scale);
+			if (iv == 0 || !(is_scaled(insn, iv) || feeds_scaled(insn))) continue;
+			int p = reduce_iv(ir, pre, body[b], insn, iv, scale);
+			bool seen = false;
+			for (int i = 0; i < derived_len; i++) seen = seen || derived[i] == p;
+			if (!seen) derived[derived_len++] = p;
+		}
+	}
+	for (int i = 0; i < derived_len; i++) remove_unused(derived[i]);
+}
+
+/**
+ * @brief ループごとに、不変な計算を前置ブロックへ出し、配列の添字の掛け算を足し算で進むポインタにする.
+ * 内側のループから順に見るので、外に出した命令はさらに外側のループの外へ出せる
+ *
+ * @param ir
+ */
+void ir_loop(IRFunc *ir) {
+	int head_count = 0;
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) head_count += bb->loop_head;
+	if (head_count == 0) return;
+	BasicBlock **heads = alloc_zero(head_count, sizeof(BasicBlock *));
+	int i = 0;
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) {
+		if (bb->loop_head) heads[i++] = bb;
+	}
+
+	for (i = head_count - 1; i >= 0; i--) {
+		if (heads[i] == ir->entry || !find_loop(ir, heads[i])) continue;
+		BasicBlock *pre = make_preheader(ir, heads[i]);
+		count_defs_uses(ir);
+		hoist(ir, pre);
+		count_defs_uses(ir);
+		strength_reduce(ir, pre);
+	}
+	free(heads);
+
+	// 前置ブロックを足したので、出力順に番号を振り直す
+	ir->block_count = 0;
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) bb->id = ir->block_count++;
+}
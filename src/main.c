@@ -9,26 +9,148 @@
  * 
  */
 #include "SverigeCC.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 char *user_input;
+char *user_input_end;
+char *input_path;
+int opt_level;
+// --peephole-statsのとき、最後にpeepholeの規則ごとの適用回数を書き出す
+static bool peephole_stats;
 
-int main(int argc, char **argv) {
-	if (argc != 2) {
-		fprintf(stderr, "argc is not equal 2\n");
-		return 1;
-	} else {
-		// fprintf(stderr, "input code : %s\n", argv[1]);
+/**
+ * @brief fdを最後まで読んでmallocした領域に入れる(パイプや標準入力用)
+ * 
+ */
+static char *read_all(int fd, size_t *size) {
+	size_t cap = 1 << 16, len = 0;
+	char *buf = malloc(cap);
+	for (;;) {
+		if (buf == NULL) error("out of memory (input)\n");
+		ssize_t n = read(fd, buf + len, cap - len);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			error("cannot read %s: %s\n", input_path, strerror(errno));
+		}
+		if (n == 0) break;
+		len += n;
+		if (len == cap) buf = realloc(buf, cap *= 2);
+	}
+	*size = len;
+	return buf;
+}
+
+/**
+ * @brief 入力をuser_input, user_input_endに読み込む.
+ * 通常のファイルは読み取り専用でmmapし、コピーせずにそのまま字句解析する
+ * 
+ * @param path "-"なら標準入力
+ * @return true mmapした
+ * @return false mallocした
+ */
+static bool load_input(char *path) {
+	input_path = path;
+	size_t size;
+	if (strcmp(path, "-") == 0) {
+		input_path = "<stdin>";
+		user_input = read_all(0, &size);
+		user_input_end = user_input + size;
+		return false;
 	}
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) error("cannot open %s: %s\n", path, strerror(errno));
+	struct stat st;
+	if (fstat(fd, &st) < 0) error("cannot stat %s: %s\n", path, strerror(errno));
+	bool mapped = false;
+	if (S_ISREG(st.st_mode) && st.st_size > 0) {
+		user_input = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (user_input == MAP_FAILED) error("cannot mmap %s: %s\n", path, strerror(errno));
+		madvise(user_input, st.st_size, MADV_SEQUENTIAL);
+		size = st.st_size;
+		mapped = true;
+	} else user_input = read_all(fd, &size);
+	close(fd);
+	user_input_end = user_input + size;
+	return mapped;
+}
+
+static void unload_input(bool mapped) {
+	if (mapped) munmap(user_input, user_input_end - user_input);
+	else free(user_input);
+	user_input = user_input_end = NULL;
+}
+
+/**
+ * @brief foo.c -> foo.s
+ * 
+ */
+static char *asm_path(char *path) {
+	size_t len = strlen(path);
+	if (len >= 2 && strcmp(path + len - 2, ".c") == 0) len -= 2;
+	char *res = malloc(len + 3);
+	memcpy(res, path, len);
+	strcpy(res + len, ".s");
+	return res;
+}
 
-	user_input = argv[1];
-	token = tokenize(user_input);
-	// for (Token *now = token; now->kind != TK_EOF; now = now->next) {
-	// 	fprintf(stderr, "%s, %d, %d\n", now->str, now->len, now->val);
-	// }
-	fprintf(stderr, "tokenize OK\n");
+static void compile(char *path, char *output_path) {
+	bool mapped = load_input(path);
+	tokenize(user_input, user_input_end);
 
-	printf(".intel_syntax noprefix\n");
+	if (output_path) emit_to_file(output_path);
+	else emit_to_fd(1);
+	emit(".intel_syntax noprefix\n");
 	program();
+	emit_close();
+
+	// 次の入力のために、このファイルのグローバル変数と関数を捨てる
+	arena_reset(&global_arena);
+	unload_input(mapped);
+}
+
+int main(int argc, char **argv) {
+	char *output_path = NULL;
+	char **inputs = calloc(argc, sizeof(char *));
+	int input_count = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--arena-stats") == 0) arena_debug = true;
+		else if (strcmp(argv[i], "--dump-ir") == 0) dump_ir = true;
+		else if (strcmp(argv[i], "--check-align") == 0) check_align = true;
+		else if (strcmp(argv[i], "--no-peephole") == 0) peephole_enabled = false;
+		else if (strcmp(argv[i], "--no-inline") == 0) inline_enabled = false;
+		else if (strcmp(argv[i], "--peephole-stats") == 0) peephole_stats = true;
+		else if (strcmp(argv[i], "-O0") == 0) opt_level = 0;
+		else if (strcmp(argv[i], "-O1") == 0) opt_level = 1;
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) output_path = argv[++i];
+		else inputs[input_count++] = argv[i];
+	}
+	// ファイルが指定されなければ標準入力を読んで標準出力に書く
+	if (input_count == 0) inputs[input_count++] = "-";
+	if (output_path && input_count > 1) {
+		fprintf(stderr, "-o can't be used with multiple inputs\n");
+		return 1;
+	}
+
+	for (int i = 0; i < input_count; i++) {
+		if (output_path || strcmp(inputs[i], "-") == 0) compile(inputs[i], output_path);
+		else {
+			char *path = asm_path(inputs[i]);
+			compile(inputs[i], path);
+			free(path);
+		}
+	}
 	fprintf(stderr, "output assembly\n");
+
+	if (arena_debug) arena_report();
+	if (peephole_stats) peephole_report();
+	arena_free(&node_arena);
+	arena_free(&global_arena);
+	arena_free(&type_arena);
+	arena_free(&ident_arena);
+	free(inputs);
 	return 0;
 }
\ No newline at end of file
@@ -10,72 +10,66 @@
  */
 #include "SverigeCC.h"
 
+// 変数リストの番兵の型. 大きさ0
+static Type sentinel_type;
+
 static Var *lvar_list;
+// 今の関数でローカル変数のアドレスを取ったか
+static bool lvar_addr_taken;
 Var *gvar_list;
 Function *func_list;
 
+static SymTab lvar_tab;
+static SymTab gvar_tab;
+static SymTab func_tab;
+
 ////////////////////////////////////////////////////////////////////////////
 // variable tool
 ////////////////////////////////////////////////////////////////////////////
 
-Function *find_func(char *name) {
-	for (Function *now = func_list; now; now = now->next) {
-		if (now->name != NULL && strcmp(name, now->name) == 0) {
-			return now;
-		}
-	}
-	// error("そんな関数はない\n");
-	return NULL;
+Function *find_func(int id) {
+	return symtab_find(&func_tab, id);
 }
 
 /**
- * @brief tok->strと一致するようなグローバル変数を探す
+ * @brief tokと一致するようなグローバル変数を探す
  * 
  * @param tok 
  * @return Var* 
  */
-static Var *find_gvar(Token *tok) {
-	for (Var *now = gvar_list; now; now = now->next) {
-		if (tok->len == now->len && memcmp(tok->str, now->name, tok->len) == 0) {
-			return now;
-		}
-	}
-	return NULL;
+static Var *find_gvar(int tok) {
+	return symtab_find(&gvar_tab, tok_id(tok));
 }
 
 /**
- * @brief tok->strと一致するようなローカル変数を探す
+ * @brief tokと一致するようなローカル変数を探す
  * 
  * @param tok 
  * @return LVar* 
  */
-static Var *find_lvar(Token *tok) {
-	for (Var *now = lvar_list; now; now = now->next) {
-		if (tok->len == now->len && memcmp(tok->str, now->name, tok->len) == 0) {
-			return now;
-		}
-	}
-	return NULL;
+static Var *find_lvar(int tok) {
+	return symtab_find(&lvar_tab, tok_id(tok));
 }
 /**
  * @brief グローバル変数リストに加えるだけ
  * 
  * @param tok 
  * @param type 
- * @return int 
+ * @return Var* 
  */
-static int add_gvar(Token *tok, Type *type) {
-	Var *gvar = find_gvar(tok);
-	if (gvar) error_at(tok->str, "変数名がかぶってます(add_gvar)\n");
-	gvar = calloc(1, sizeof(Var));
-	gvar->name = strndup(tok->str, tok->len);
-	gvar->len = tok->len;
+static Var *add_gvar(int tok, Type *type) {
+	Var *gvar = symtab_find_in_scope(&gvar_tab, tok_id(tok));
+	if (gvar) error_at(tok_str(tok), "変数名がかぶってます(add_gvar)\n");
+	gvar = arena_alloc(&global_arena, sizeof(Var));
+	gvar->name = intern_name(tok_id(tok));
+	gvar->id = tok_id(tok);
 	if (gvar_list->offset == 0 && gvar_list->type->_sizeof == 0) gvar->offset = 8;
 	else gvar->offset = gvar_list->offset + gvar_list->type->_sizeof;
 	gvar->next = gvar_list;
 	gvar->type = type;
 	gvar_list = gvar;
-	return gvar->offset;
+	symtab_add(&gvar_tab, gvar->id, gvar);
+	return gvar;
 }
 
 /**
@@ -83,95 +77,106 @@ static int add_gvar(Token *tok, Type *type) {
  * 
  * @param tok 
  * @param type 
- * @return int 
+ * @return Var* 
  */
-static int add_lvar(Token *tok, Type *type) {
-	Var *lvar = find_lvar(tok);
-	if (lvar) error_at(tok->str, "変数名がかぶってます(add_lvar)\n");
-	lvar = calloc(1, sizeof(Var));
-	lvar->name = tok->str;
-	lvar->len = tok->len;
+static Var *add_lvar(int tok, Type *type) {
+	Var *lvar = symtab_find_in_scope(&lvar_tab, tok_id(tok));
+	if (lvar) error_at(tok_str(tok), "変数名がかぶってます(add_lvar)\n");
+	lvar = arena_alloc(&node_arena, sizeof(Var));
+	lvar->name = intern_name(tok_id(tok));
+	lvar->id = tok_id(tok);
 	if (lvar_list->offset == 0 && lvar_list->type->_sizeof == 0) lvar->offset = 8;
 	else lvar->offset = lvar_list->offset + lvar_list->type->_sizeof;
 	lvar->next = lvar_list;
 	lvar->type = type;
 	lvar_list = lvar;
-	return lvar->offset;
+	symtab_add(&lvar_tab, lvar->id, lvar);
+	return lvar;
 }
 
 static void add_func(Function *func) {
-	Function *f = find_func(func->name);
+	Function *f = find_func(func->id);
 	if (f) error("関数名がかぶってます(add_func)\n");
 	func->next = func_list;
 	func_list = func;
+	symtab_add(&func_tab, func->id, func);
 }
 
+////////////////////////////////////////////////////////////////////////////
+// new node tool
+////////////////////////////////////////////////////////////////////////////
+
 /**
- * @brief tok->strという変数のオフセットを計算し、ノードを作成
+ * @brief kindのノードに必要な大きさ. 共通部分とkindで使う分だけを確保する
  * 
- * @param tok 
- * @return Node* 
+ * @param kind 
+ * @return size_t 
  */
-static Node *new_node_var(Token *tok) {
-	Node *node = calloc(1, sizeof(Node));
-	Var *var = find_lvar(tok);
-	if (var) {
-		node->kind = ND_LVAR;
-		node->offset = var->offset;
-		node->type = var->type;
-		return node;
-	} 
-	var = find_gvar(tok);
-	if (var) {
-		node->kind = ND_GVAR;
-		node->type = var->type;
-		node->var_name = var->name;
-		return node;
-	} else error("知らない変数です\n");
-	return NULL;
+static size_t node_size(NodeKind kind) {
+	switch (kind)
+	{
+	case ND_NUM:
+		return offsetof(Node, val) + sizeof(int);
+	case ND_LVAR:
+	case ND_GVAR:
+	case ND_ARG:
+		return offsetof(Node, var) + sizeof(Var *);
+	case ND_IF:
+		return offsetof(Node, else_stmt) + sizeof(Node *);
+	case ND_FOR:
+		return offsetof(Node, loop) + sizeof(Node *);
+	case ND_BLOCK:
+		return offsetof(Node, body) + sizeof(Node *);
+	case ND_FUNCALL:
+		return offsetof(Node, arg_count) + sizeof(int);
+	case ND_NULL:
+		return offsetof(Node, lhs);
+	default:
+		return offsetof(Node, rhs) + sizeof(Node *);
+	}
 }
 
 /**
- * @brief 変数宣言と同時に初期化もするようなコードに対する処理
+ * @brief kindのノードをnode_arenaに作る. 最適化のパスからも使う
  * 
- * @param tok 
- * @param type 
+ * @param kind 
  * @return Node* 
  */
-static Node *new_node_lvar_dec(Token *tok, Type *type) {
-	Node *node = calloc(1, sizeof(Node));
-	node->kind = ND_LVAR;
-	node->offset = add_lvar(tok, type);
-	node->type = type;
+Node *new_node(NodeKind kind) {
+	Node *node = arena_alloc(&node_arena, node_size(kind));
+	node->kind = kind;
 	return node;
 }
 
-////////////////////////////////////////////////////////////////////////////
-// new node tool
-////////////////////////////////////////////////////////////////////////////
-
-static void set_node_kind(Node *node, NodeKind kind) {
-	node->kind = kind;
+/**
+ * @brief nodeを1つarenaに複製する. 子ノードは同じものを指したまま
+ * 
+ * @param node 
+ * @param arena 
+ * @return Node* 
+ */
+Node *copy_node(Node *node, Arena *arena) {
+	size_t size = node_size(node->kind);
+	Node *res = arena_alloc(arena, size);
+	memcpy(res, node, size);
+	return res;
 }
 
 static Node *new_node_LR(NodeKind kind, Node *lhs, Node *rhs) {
-	Node *node = calloc(1, sizeof(Node));
-	set_node_kind(node, kind);
+	Node *node = new_node(kind);
 	node->lhs = lhs;
 	node->rhs = rhs;
 	return node;
 }
 
 static Node *new_node_set_num(int val) {
-	Node *node = calloc(1, sizeof(Node));
-	set_node_kind(node, ND_NUM);
+	Node *node = new_node(ND_NUM);
 	node->val = val;
 	return node;
 }
 
 static Node *new_node_if(Node *condition, Node *then_stmt, Node *else_stmt) {
-	Node *node = calloc(1, sizeof(Node));
-	set_node_kind(node, ND_IF);
+	Node *node = new_node(ND_IF);
 	node->condition = condition;
 	node->then_stmt = then_stmt;
 	node->else_stmt = else_stmt;
@@ -179,14 +184,48 @@ static Node *new_node_if(Node *condition, Node *then_stmt, Node *else_stmt) {
 }
 
 static Node *new_node_for(Node *init, Node *condition, Node *loop) {
-	Node *node = calloc(1, sizeof(Node));
-	set_node_kind(node, ND_FOR);
+	Node *node = new_node(ND_FOR);
 	node->init = init;
 	node->condition = condition;
 	node->loop = loop;
 	return node;
 }
 
+/**
+ * @brief tokという変数のノードを作成
+ * 
+ * @param tok 
+ * @return Node* 
+ */
+static Node *new_node_var(int tok) {
+	Node *node;
+	Var *var = find_lvar(tok);
+	if (var) node = new_node(ND_LVAR);
+	else {
+		var = find_gvar(tok);
+		if (var == NULL) error_at(tok_str(tok), "知らない変数です\n");
+		node = new_node(ND_GVAR);
+	}
+	node->var = var;
+	node->type = var->type;
+	return node;
+}
+
+/**
+ * @brief 変数宣言と同時に初期化もするようなコードに対する処理
+ * 
+ * @param kind ND_LVARかND_ARG
+ * @param tok 
+ * @param type 
+ * @return Node* 
+ */
+static Node *new_node_lvar_dec(NodeKind kind, int tok, Type *type) {
+	Node *node = new_node(kind);
+	node->var = add_lvar(tok, type);
+	node->type = type;
+	return node;
+}
+
 ////////////////////////////////////////////////////////////////////////////
 // construct abstract syntax tree
 ////////////////////////////////////////////////////////////////////////////
@@ -196,189 +235,175 @@ static Node *stmt(void);
 static Node *pre_stmt(void);
 static Node *new_add(Node *node1, Node *node2);
 
-static Node *read_funcall(Token *name) {
-	if (!consume("(")) return NULL;
+static Node *read_funcall(int name) {
+	if (!consume(TK_LPAREN)) return NULL;
 	next();
-	Node *node = calloc(1, sizeof(Node));
-	set_node_kind(node, ND_FUNCALL);
-	node->funcname = strndup(name->str, name->len);
-	Node *now = node;
-	while (!consume_nxt(")")) {
+	Node *node = new_node(ND_FUNCALL);
+	node->funcname = intern_name(tok_id(name));
+	node->func_id = tok_id(name);
+	Node **now = &(node->args);
+	while (!consume_nxt(TK_RPAREN)) {
 		Node *arg = expr();
-		now->next = arg;
-		now = arg;
-		consume_nxt(",");
+		*now = arg;
+		now = &(arg->next);
+		node->arg_count++;
+		consume_nxt(TK_COMMA);
 	}
 	return node;
 }
 
 static Type *read_ptr(Type *basetype) {
 	Type *now = basetype;
-	while (consume_nxt("*")) {
-		Type *tmp = new_type(TP_PTR, now, 8);
-		now = tmp;
+	while (consume_nxt(TK_STAR)) {
+		now = pointer_to(now);
 	}
 	return now;
 }
 
 static Type *read_array(Type *ty) {
-	if (!consume_nxt("[")) return ty;
-	Type *now = calloc(1, sizeof(Type));
-	now->ty = TP_ARRAY;
-	now->array_size = expect_num_nxt();
-	consume_nxt("]");
-	ty = read_array(ty);
-	now->ptr_to = ty;
-	now->_sizeof = now->array_size * ty->_sizeof;
-	return now;
+	if (!consume_nxt(TK_LBRACKET)) return ty;
+	int array_size = expect_num_nxt();
+	consume_nxt(TK_RBRACKET);
+	return array_of(read_array(ty), array_size);
 }
 
-static Node *read_basetype() {
-	if (consume_d_type() == 0) return NULL;
-	int type_id = get_d_type_id();
-	Node *node = calloc(1, sizeof(Node));
-	switch (type_id)
+static Type *read_basetype() {
+	Type *type;
+	switch (tok_kind(token))
 	{
-	case 0: // int
-		node->type = new_type(TP_INT, NULL, 8);
+	case TK_INT:
+		type = ty_int;
 		break;
-	case 1: // char
-		node->type = new_type(TP_CHAR, NULL, 1);
+	case TK_CHAR:
+		type = ty_char;
 		break;
 	default:
-		error("その型は知らん\n");
-		break;
+		return NULL;
 	}
 	next();
-	return node;
+	return type;
 }
 
 static Node *read_return(void) {
 	Node *res = new_node_LR(ND_RETURN, expr(), NULL);
-	expect_nxt(";");
+	expect_nxt(TK_SEMI);
 	return res;
 }
 
 static Node *read_if(void) {
-	expect_nxt("(");
+	expect_nxt(TK_LPAREN);
 	Node *res = new_node_if(expr(), NULL, NULL);
-	expect_nxt(")");
+	expect_nxt(TK_RPAREN);
 	res->then_stmt = stmt();
-	int next_control_id = -1;
-	if (consume_cntrl()) next_control_id = get_cntrl_id();
-	if (next_control_id == 2) {
-		res->else_stmt = stmt();
-	}
+	if (consume_nxt(TK_ELSE)) res->else_stmt = stmt();
 	return res;
 }
 
 static Node *read_while(void) {
-	expect_nxt("(");
+	expect_nxt(TK_LPAREN);
 	Node *res = new_node_LR(ND_WHILE, expr(), NULL);
-	expect_nxt(")");
+	expect_nxt(TK_RPAREN);
 	res->rhs = stmt();
 	return res;
 }
 
 static Node *read_for(void) {
 	Node *res = new_node_for(NULL, NULL, NULL);
-	expect_nxt("(");
-	if (!consume_nxt(";")) {
+	expect_nxt(TK_LPAREN);
+	if (!consume_nxt(TK_SEMI)) {
 		res->init = expr();
-		expect_nxt(";");
+		expect_nxt(TK_SEMI);
 	}
-	if (!consume_nxt(";")) {
+	if (!consume_nxt(TK_SEMI)) {
 		res->condition = expr();
-		expect_nxt(";");
+		expect_nxt(TK_SEMI);
 	}
-	if (!consume_nxt(")")) {
+	if (!consume_nxt(TK_RPAREN)) {
 		res->loop = expr();
-		expect_nxt(")");
+		expect_nxt(TK_RPAREN);
 	}
 	res->then_stmt = stmt();
 	return res;
 }
 
 static Node *read_cntrl_flow(void) {
-	if (!consume_cntrl()) return NULL;
-	int cntrl_id = get_cntrl_id();
-	next();
-	Node *node;
-	switch (cntrl_id)
+	switch (tok_kind(token))
 	{
-	case 0: // return
-		node = read_return();
-		break;
-	case 1: // if
-		node = read_if();
-		break;
-	case 3: // while
-		node = read_while();
-		break;
-	case 4: // for
-		node = read_for();
-		break;
+	case TK_RETURN:
+		next();
+		return read_return();
+	case TK_IF:
+		next();
+		return read_if();
+	case TK_WHILE:
+		next();
+		return read_while();
+	case TK_FOR:
+		next();
+		return read_for();
+	case TK_ELSE:
+		error_at(tok_str(token), "何その制御構文\n");
+		return NULL;
 	default:
-		error_at(token->str, "何その制御構文\n");
-		break;
+		return NULL;
 	}
-	return node;
 }
 
 static Node *read_block(void) {
-	if (!consume("{")) return NULL;
+	if (!consume(TK_LBRACE)) return NULL;
 	next();
-	Node *res = new_node_LR(ND_BLOCK, NULL, NULL);
-	Node *now = res;
-	while (!consume_nxt("}")) {
+	Node *res = new_node(ND_BLOCK);
+	Node **now = &(res->body);
+	while (!consume_nxt(TK_RBRACE)) {
 		Node *statement = stmt();
-		now->next = statement;
-		now = statement;
+		if (statement == NULL) continue;
+		*now = statement;
+		now = &(statement->next);
 	}
-	now->next = NULL;
 	return res;
 }
 
 static bool read_argument(Function *func) {
-	if (!consume_nxt("(")) return false;
+	if (!consume_nxt(TK_LPAREN)) return false;
 	Node **now_arg = &(func->arg);
 	int arg_cnt = 0;
-	while (!consume_nxt(")")) {
-		Type *now = read_basetype()->type;
+	while (!consume_nxt(TK_RPAREN)) {
+		Type *now = read_basetype();
+		if (now == NULL) error_at(tok_str(token), "型を宣言しろ\n");
 		now = read_ptr(now);
 		expect_ident();
-		Node *arg = new_node_lvar_dec(token, now);
-		arg->kind = ND_ARG;
+		Node *arg = new_node_lvar_dec(ND_ARG, token, now);
 		*now_arg = arg;
-		now_arg = &(arg->next_arg);
+		now_arg = &(arg->next);
 		arg_cnt++;
 		next();
-		consume_nxt(",");
+		consume_nxt(TK_COMMA);
 	}
 	func->arg_count = arg_cnt;
 	return true;
 }
 
 static void read_stmt(Function *func) {
-	expect_nxt("{");
+	expect_nxt(TK_LBRACE);
 	Node **now = &(func->stmt);
-	while (!consume_nxt("}")) {
+	while (!consume_nxt(TK_RBRACE)) {
 		Node *statement = pre_stmt();
+		if (statement == NULL) continue;
 		*now = statement;
-		now = &(statement->next_stmt);
+		now = &(statement->next);
 	}
 }
 
 static Node *primary(void) {
 	// "(" expression ")"
-	if (consume_nxt("(")) {
+	if (consume_nxt(TK_LPAREN)) {
 		Node *node = expr();
-		expect_nxt(")");
+		expect_nxt(TK_RPAREN);
 		return node;
 	}
 	// function call or variable
 	if (is_ident()) {
-		Token *name = token;
+		int name = token;
 		expect_ident_nxt();
 		Node *funcall = read_funcall(name);
 		if (funcall != NULL) return funcall;
@@ -386,15 +411,15 @@ static Node *primary(void) {
 	}
 	// number
 	// マジで????
-	if (token->kind == TK_NUM) return new_node_set_num(expect_num_nxt());
+	if (tok_kind(token) == TK_NUM) return new_node_set_num(expect_num_nxt());
 	return unary();
 }
 
 static Node *postfix(void) {
 	Node *node1 = primary();
-	while (consume_nxt("[")) {
+	while (consume_nxt(TK_LBRACKET)) {
 		Node *node2 = expr();
-		expect_nxt("]");
+		expect_nxt(TK_RBRACKET);
 		Node *add = new_add(node1, node2);
 		node1 = new_node_LR(ND_DEREF, add, NULL);
 	}
@@ -402,19 +427,20 @@ static Node *postfix(void) {
 }
 
 static Node *unary(void) {
-	if (consume_nxt("+")) {
+	if (consume_nxt(TK_PLUS)) {
 		Node *node = primary();
 		return node;
-	} else if (consume_nxt("-")) {
+	} else if (consume_nxt(TK_MINUS)) {
 		Node *node = new_node_LR(ND_SUB, new_node_set_num(0), primary());
 		return node;
-	} else if (consume_nxt("*")) {
+	} else if (consume_nxt(TK_STAR)) {
 		Node *node = new_node_LR(ND_DEREF, unary(), NULL);
 		return node;
-	} else if (consume_nxt("&")) {
+	} else if (consume_nxt(TK_AMP)) {
 		Node *node = new_node_LR(ND_ADDR, unary(), NULL);
+		if (node->lhs->kind == ND_LVAR) lvar_addr_taken = true;
 		return node;
-	} else if (consume_nxt("sizeof")) {
+	} else if (consume_nxt(TK_SIZEOF)) {
 		Node *node = unary();
 		type_analyzer(node);
 		return new_node_set_num(node->type->_sizeof);
@@ -426,8 +452,8 @@ static Node *unary(void) {
 static Node *mul(void) {
 	Node *node = unary();
 	for (;;) {
-		if (consume_nxt("*")) node = new_node_LR(ND_MUL, node, unary());
-		else if (consume_nxt("/")) node = new_node_LR(ND_DIV, node, unary());
+		if (consume_nxt(TK_STAR)) node = new_node_LR(ND_MUL, node, unary());
+		else if (consume_nxt(TK_SLASH)) node = new_node_LR(ND_DIV, node, unary());
 		else return node;
 	}
 }
@@ -450,7 +476,7 @@ static Node *new_add(Node *node1, Node *node2) {
 	if (is_int(node1->type) && is_array(node2->type)) {
 		return new_node_LR(ND_PTR_ADD, node2, node1);
 	}
-	error_at(token->str, "何その式(new_add)\n");
+	error_at(tok_str(token), "何その式(new_add)\n");
 	return NULL;
 }
 
@@ -473,8 +499,8 @@ static Node *new_sub(Node *node1, Node *node2) {
 static Node *add(void) {
 	Node *node = mul();
 	for (;;) {
-		if (consume_nxt("+")) node = new_add(node, mul());
-		else if (consume_nxt("-")) node = new_sub(node, mul());
+		if (consume_nxt(TK_PLUS)) node = new_add(node, mul());
+		else if (consume_nxt(TK_MINUS)) node = new_sub(node, mul());
 		else return node;
 	}
 }
@@ -482,26 +508,32 @@ static Node *add(void) {
 static Node *relational(void) {
 	Node *node = add();
 	for (;;) {
-		if (consume_nxt(">=")) node = new_node_LR(ND_GE, node, add());
-		else if (consume_nxt("<=")) node = new_node_LR(ND_LE, node, add());
-		else if (consume_nxt(">")) node = new_node_LR(ND_GT, node, add());
-		else if (consume_nxt("<")) node = new_node_LR(ND_LT, node, add());
-		else return node;
+		NodeKind kind;
+		switch (tok_kind(token))
+		{
+		case TK_GE: kind = ND_GE; break;
+		case TK_LE: kind = ND_LE; break;
+		case TK_GT: kind = ND_GT; break;
+		case TK_LT: kind = ND_LT; break;
+		default: return node;
+		}
+		next();
+		node = new_node_LR(kind, node, add());
 	}
 }
 
 static Node *equality(void) {
 	Node *node = relational();
 	for(;;) {
-		if (consume_nxt("==")) node = new_node_LR(ND_EQ, node, relational());
-		else if (consume_nxt("!=")) node = new_node_LR(ND_NEQ, node, relational());
+		if (consume_nxt(TK_EQ)) node = new_node_LR(ND_EQ, node, relational());
+		else if (consume_nxt(TK_NE)) node = new_node_LR(ND_NEQ, node, relational());
 		return node;
 	}
 }
 
 static Node *assign(void) {
 	Node *node = equality();
-	if (consume_nxt("=")) node = new_node_LR(ND_ASSIGN, node, assign());
+	if (consume_nxt(TK_ASSIGN)) node = new_node_LR(ND_ASSIGN, node, assign());
 	return node;
 }
 
@@ -511,24 +543,24 @@ static Node *expr(void) {
 }
 
 static Node *lvar_declaration(void) {
-	Node *node = read_basetype();
-	if (node == NULL) return NULL;
+	Type *type = read_basetype();
+	if (type == NULL) return NULL;
 	// add pointer
-	node->type = read_ptr(node->type);
+	type = read_ptr(type);
 	// variable name
-	Token *var_name = consume_ident_nxt();
-	node->type = read_array(node->type);
-	if (consume_nxt(";")) {
+	int var_name = consume_ident_nxt();
+	if (var_name < 0) error_at(tok_str(token), "not ident\n");
+	type = read_array(type);
+	if (consume_nxt(TK_SEMI)) {
 		// declaration only
-		add_lvar(var_name, node->type);
-		node->kind = ND_NULL;
-		return node;
+		add_lvar(var_name, type);
+		return new_node(ND_NULL);
 	}
 	// variable initialization
-	expect_nxt("=");
-	node = new_node_lvar_dec(var_name, node->type);
+	expect_nxt(TK_ASSIGN);
+	Node *node = new_node_lvar_dec(ND_LVAR, var_name, type);
 	Node *r = equality();
-	consume_nxt(";");
+	consume_nxt(TK_SEMI);
 	type_analyzer(r);
 	return new_node_LR(ND_ASSIGN, node, r);
 }
@@ -545,13 +577,13 @@ static Node *stmt(void) {
 	Node *block = read_block();
 	if (block != NULL) return block;
 	// only ";"
-	if (consume_nxt(";")) {
+	if (consume_nxt(TK_SEMI)) {
 		node = NULL;
 		return node;
 	}
 	// expression
 	node = expr();
-	expect_nxt(";");
+	expect_nxt(TK_SEMI);
 	return node;
 }
 
@@ -561,9 +593,10 @@ static Node *pre_stmt(void) {
 	return node;
 }
 
-static Function *func_def(Type *base, char *name) {
-	Function *func = calloc(1, sizeof(Function));
-	func->name = name;
+static Function *func_def(Type *base, int name_id) {
+	Function *func = arena_alloc(&global_arena, sizeof(Function));
+	func->name = intern_name(name_id);
+	func->id = name_id;
 	func->type = base;
 	// argument
 	if (!read_argument(func)) return NULL;
@@ -571,48 +604,53 @@ static Function *func_def(Type *base, char *name) {
 	read_stmt(func);
 	// calcurate total offset
 	func->total_offset = lvar_list->offset + lvar_list->type->_sizeof;
+	func->local = lvar_list;
+	func->addr_taken = lvar_addr_taken;
 	add_func(func);
 	return func;
 }
 
-static void gvar_declaration(Token *tok, Type *base) {
+static void gvar_declaration(int tok, Type *base) {
 	base = read_array(base);
 	add_gvar(tok, base);
-	expect_nxt(";");
+	expect_nxt(TK_SEMI);
 }
 
 static Function *gvar_or_func_def(void) {
-	Node *basetype = read_basetype();
-	if (basetype == NULL) error_at(token->str, "型を宣言しろ\n");
+	Type *basetype = read_basetype();
+	if (basetype == NULL) error_at(tok_str(token), "型を宣言しろ\n");
 	// read pointer
-	basetype->type = read_ptr(basetype->type);
+	basetype = read_ptr(basetype);
 	expect_ident();
 	// read name
-	char *name = strndup(token->str, token->len);
-	Token *tok = token;
+	int tok = token;
 	next();
 	// function define
-	Function *func = func_def(basetype->type, name);
+	Function *func = func_def(basetype, tok_id(tok));
 	if (func != NULL) return func;
 	// global variable
-	gvar_declaration(tok, basetype->type);
+	gvar_declaration(tok, basetype);
 	return NULL;
 }
 
 static void lvar_init(void) {
-	lvar_list = calloc(1, sizeof(Var));
-	lvar_list->type = calloc(1, sizeof(Type));
+	symtab_clear(&lvar_tab);
+	lvar_list = arena_alloc(&node_arena, sizeof(Var));
+	lvar_list->type = &sentinel_type;
+	lvar_addr_taken = false;
 }
 
 static void gvar_init(void) {
-	gvar_list = calloc(1, sizeof(Var));
-	gvar_list->type = calloc(1, sizeof(Type));
+	symtab_clear(&gvar_tab);
+	gvar_list = arena_alloc(&global_arena, sizeof(Var));
+	gvar_list->type = &sentinel_type;
 	gvar_list->is_write = true;
 }
 
 static void func_init(void) {
-	func_list = calloc(1, sizeof(Function));
-	func_list->type = calloc(1, sizeof(Type));
+	symtab_clear(&func_tab);
+	func_list = arena_alloc(&global_arena, sizeof(Function));
+	func_list->type = &sentinel_type;
 }
 
 void program(void) {
@@ -620,6 +658,19 @@ void program(void) {
 	func_init();
 	while (!at_eof()) {
 		lvar_init();
-		func_gen(gvar_or_func_def());
+		Function *func = gvar_or_func_def();
+		if (func && opt_level >= 1) {
+			// 展開してから畳み込むと、定数の実引数が展開した式の中まで伝わる
+			inline_calls(func);
+			fold_function(func);
+			inline_register(func);
+		}
+		func_gen(func);
+		// 出力し終わった関数の抽象構文木とローカル変数はもう使わないので解放する
+		if (func) {
+			func->arg = NULL;
+			func->stmt = NULL;
+		}
+		arena_reset(&node_arena);
 	}
 }
\ No newline at end of file
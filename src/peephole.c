@@ -0,0 +1,273 @@
+/**
+ * @file peephole.c
+ * @author Takamasa Naruse
+ * @brief peephole optimization over the emitted instructions of a function
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "SverigeCC.h"
+
+// --no-peepholeで切る
+bool peephole_enabled = true;
+
+typedef enum {
+	LN_INSN,	// "  op a, b"
+	LN_LABEL,	// "name:"
+	LN_OTHER,	// ディレクティブなど. 命令の並びの区切りとして扱う
+} LineKind;
+
+/**
+ * @brief 出力の1行. 命令ならオペランドに分けておく
+ *
+ */
+typedef struct {
+	LineKind kind;
+	// 出力する文字列(改行なし)
+	char *text;
+	char *op;
+	// オペランド. なければNULL
+	char *a;
+	char *b;
+	bool dead;
+} Line;
+
+static Line *lines;
+static int line_count;
+static int line_cap;
+
+////////////////////////////////////////////////////////////////////////////
+// parse
+////////////////////////////////////////////////////////////////////////////
+
+// 解析用に行をコピーして、空白とカンマで区切る
+static void parse_line(Line *line, char *text) {
+	line->text = text;
+	line->op = line->a = line->b = NULL;
+	line->dead = false;
+	if (text[0] != ' ') {
+		size_t len = strlen(text);
+		line->kind = len > 0 && text[len - 1] == ':' ? LN_LABEL : LN_OTHER;
+		if (line->kind == LN_LABEL) {
+			line->op = arena_alloc(&node_arena, len);
+			memcpy(line->op, text, len - 1);
+		}
+		return;
+	}
+	while (*text == ' ') text++;
+	if (*text == '.') {
+		line->kind = LN_OTHER;
+		return;
+	}
+	line->kind = LN_INSN;
+	size_t len = strlen(text);
+	char *copy = arena_alloc(&node_arena, len + 1);
+	memcpy(copy, text, len);
+	line->op = copy;
+	char *p = strchr(copy, ' ');
+	if (p == NULL) return;
+	*p++ = '\0';
+	line->a = p;
+	p = strstr(p, ", ");
+	if (p == NULL) return;
+	*p = '\0';
+	line->b = p + 2;
+}
+
+static char *format(char *fmt, char *x, char *y) {
+	char buf[128];
+	int len = snprintf(buf, sizeof(buf), fmt, x, y);
+	char *res = arena_alloc(&node_arena, len + 1);
+	memcpy(res, buf, len);
+	return res;
+}
+
+static void rewrite(Line *line, char *op, char *a, char *b) {
+	char *text = b ? format("  %s %s, ", op, a) : format("  %s %s", op, a);
+	if (b) text = format("%s%s", text, b);
+	parse_line(line, text);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// helpers
+////////////////////////////////////////////////////////////////////////////
+
+static bool is_op(Line *line, char *op) {
+	return line && line->kind == LN_INSN && strcmp(line->op, op) == 0;
+}
+
+static bool same(char *x, char *y) {
+	return x && y && strcmp(x, y) == 0;
+}
+
+static bool is_mem(char *operand) {
+	return strchr(operand, '[') != NULL;
+}
+
+static bool is_ident_char(char c) {
+	return ('a' <= c && c <= 'z') || ('0' <= c && c <= '9') || c == '_';
+}
+
+// オペランドの中にレジスタregが出てくるか("[rbp-8]"の中も見る)
+static bool mentions(char *operand, char *reg) {
+	size_t len = strlen(reg);
+	for (char *p = strstr(operand, reg); p; p = strstr(p + 1, reg)) {
+		bool head = p == operand || !is_ident_char(p[-1]);
+		if (head && !is_ident_char(p[len])) return true;
+	}
+	return false;
+}
+
+// 64ビットのレジスタと、その下位32ビットの名前
+static char *reg64[] = {"rax", "rdi", "rdx", "rsi", "rcx", "rbx", "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"};
+static char *reg32[] = {"eax", "edi", "edx", "esi", "ecx", "ebx", "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"};
+
+static char *low32(char *reg) {
+	for (int i = 0; i < (int)(sizeof(reg64) / sizeof(*reg64)); i++) {
+		if (strcmp(reg, reg64[i]) == 0) return reg32[i];
+	}
+	return NULL;
+}
+
+// フラグを読む命令
+static bool reads_flags(Line *line) {
+	if (line == NULL || line->kind != LN_INSN) return false;
+	if (line->op[0] == 'j') return strcmp(line->op, "jmp") != 0;
+	return strncmp(line->op, "set", 3) == 0 || strncmp(line->op, "cmov", 4) == 0;
+}
+
+// i番目より後で、消されていない最初の行
+static Line *next_line(int i) {
+	for (int j = i + 1; j < line_count; j++) {
+		if (!lines[j].dead) return &lines[j];
+	}
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// rules
+// 各規則はlines[i]から始まる並びを見て、書き換えたらtrueを返す
+////////////////////////////////////////////////////////////////////////////
+
+// mov x, x
+static bool self_move(int i) {
+	Line *l = &lines[i];
+	if (!is_op(l, "mov") || !same(l->a, l->b)) return false;
+	l->dead = true;
+	return true;
+}
+
+// mov [m], r; mov r, [m] -> 2つ目はいらない
+static bool store_load(int i) {
+	Line *l = &lines[i], *n = next_line(i);
+	if (!is_op(l, "mov") || !is_op(n, "mov") || !is_mem(l->a)) return false;
+	if (!same(l->a, n->b) || !same(l->b, n->a)) return false;
+	n->dead = true;
+	return true;
+}
+
+// mov r, [m]; mov [m], r -> 2つ目はいらない
+static bool load_store(int i) {
+	Line *l = &lines[i], *n = next_line(i);
+	if (!is_op(l, "mov") || !is_op(n, "mov") || !is_mem(l->b)) return false;
+	if (!same(l->a, n->b) || !same(l->b, n->a) || mentions(l->b, l->a)) return false;
+	n->dead = true;
+	return true;
+}
+
+// mov r, x; mov r, y -> yがrを使わないなら1つ目はいらない
+static bool overwritten(int i) {
+	Line *l = &lines[i], *n = next_line(i);
+	if (!(is_op(l, "mov") || is_op(l, "lea")) || !(is_op(n, "mov") || is_op(n, "lea"))) return false;
+	if (!l->a || is_mem(l->a) || !low32(l->a) || !same(l->a, n->a) || mentions(n->b, l->a)) return false;
+	l->dead = true;
+	return true;
+}
+
+// jmp .L; .L: -> 飛ばなくても次に進む
+static bool jump_next(int i) {
+	Line *l = &lines[i], *n = next_line(i);
+	if (!is_op(l, "jmp") || n == NULL || n->kind != LN_LABEL || !same(l->a, n->op)) return false;
+	l->dead = true;
+	return true;
+}
+
+// mov r, 0 -> xor r32, r32. 命令が短くなる. フラグが変わるので、直後でフラグを読むときはしない
+static bool zero_reg(int i) {
+	Line *l = &lines[i];
+	if (!is_op(l, "mov") || !same(l->b, "0") || !low32(l->a) || reads_flags(next_line(i))) return false;
+	char *r = low32(l->a);
+	rewrite(l, "xor", r, r);
+	return true;
+}
+
+typedef struct {
+	char *name;
+	bool (*apply)(int i);
+	int hits;
+} Rule;
+
+// 上から順に試す. zero_regはmovの形を見る規則より後に置く
+static Rule rules[] = {
+	{"self-move", self_move, 0},
+	{"store-load", store_load, 0},
+	{"load-store", load_store, 0},
+	{"overwritten", overwritten, 0},
+	{"jump-next", jump_next, 0},
+	{"zero-reg", zero_reg, 0},
+};
+
+#define RULE_COUNT ((int)(sizeof(rules) / sizeof(*rules)))
+
+/**
+ * @brief 関数1つ分のアセンブリを受け取り、書き換えてから出力する. textは書き換えられる
+ *
+ * @param text 1行1命令で'\n'で終わる
+ * @param len
+ */
+void peephole(char *text, size_t len) {
+	line_count = 0;
+	char *end = text + len;
+	for (char *p = text; p < end;) {
+		char *nl = memchr(p, '\n', end - p);
+		if (nl == NULL) nl = end;
+		*nl = '\0';
+		if (line_count == line_cap) {
+			line_cap = line_cap ? line_cap * 2 : 1024;
+			lines = realloc(lines, sizeof(Line) * line_cap);
+			if (lines == NULL) error("out of memory (peephole)\n");
+		}
+		parse_line(&lines[line_count++], p);
+		p = nl + 1;
+	}
+
+	if (peephole_enabled) {
+		// 書き換えで新しい並びができるので、変わらなくなるまで繰り返す
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (int i = 0; i < line_count; i++) {
+				for (int r = 0; r < RULE_COUNT && !lines[i].dead; r++) {
+					if (!rules[r].apply(i)) continue;
+					rules[r].hits++;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < line_count; i++) {
+		if (!lines[i].dead) emit("%s\n", lines[i].text);
+	}
+}
+
+/**
+ * @brief 規則ごとの適用回数をエラー出力に書き出す(--peephole-statsのとき)
+ *
+ */
+void peephole_report(void) {
+	for (int r = 0; r < RULE_COUNT; r++) fprintf(stderr, "peephole %-12s: %d\n", rules[r].name, rules[r].hits);
+}
@@ -0,0 +1,292 @@
+/**
+ * @file reduce.c
+ * @author Takamasa Naruse
+ * @brief strength reduction and dead code elimination on the IR (-O1)
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "SverigeCC.h"
+
+// 各仮想レジスタの定義の数、使用の数、定義した命令(定義が1つのときだけ意味がある)
+static int *def_count;
+static int *use_count;
+static IRInsn **def_insn;
+
+static void count_defs_uses(IRFunc *ir) {
+	int nv = ir->vreg_count + 1;
+	free(def_count);
+	free(use_count);
+	free(def_insn);
+	def_count = calloc(nv, sizeof(int));
+	use_count = calloc(nv, sizeof(int));
+	def_insn = calloc(nv, sizeof(IRInsn *));
+	if (!def_count || !use_count || !def_insn) error("out of memory (reduce)\n");
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) {
+		for (IRInsn *insn = bb->head; insn; insn = insn->next) {
+			int uses[MAX_ARGS];
+			int n = ir_uses(insn, uses);
+			for (int i = 0; i < n; i++) use_count[uses[i]]++;
+			if (insn->dst) {
+				def_count[insn->dst]++;
+				def_insn[insn->dst] = insn;
+			}
+		}
+	}
+}
+
+// vregが定数なら*valに入れる. 変数のように何度も代入される仮想レジスタは定数ではない
+static bool const_of(int vreg, long *val) {
+	if (def_count[vreg] != 1 || def_insn[vreg]->kind != IR_IMM) return false;
+	*val = def_insn[vreg]->imm;
+	return true;
+}
+
+// valが2の冪なら指数を、そうでなければ-1を返す
+static int log2_of(long val) {
+	if (val <= 0 || (val & (val - 1))) return -1;
+	return __builtin_ctzl(val);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// multiply
+////////////////////////////////////////////////////////////////////////////
+
+static void set_unary(IRInsn *insn, IRKind kind, int a, long imm) {
+	insn->kind = kind;
+	insn->a = a;
+	insn->b = 0;
+	insn->imm = imm;
+}
+
+/**
+ * @brief 定数との掛け算をシフトやleaにする. ポインタの加減算の要素の大きさを掛けるところもこれで消える
+ *
+ */
+static void reduce_mul(IRInsn *insn) {
+	long c;
+	int x;
+	if (const_of(insn->b, &c)) x = insn->a;
+	else if (const_of(insn->a, &c)) x = insn->b;
+	else return;
+
+	if (c == 1) {
+		set_unary(insn, IR_MOV, x, 0);
+		return;
+	}
+	int k = log2_of(c);
+	if (k > 0) {
+		set_unary(insn, IR_SHL, x, k);
+		return;
+	}
+	// x*3, x*5, x*9はlea dst, [x+x*2]などで1命令になる
+	if (c == 3 || c == 5 || c == 9) {
+		insn->kind = IR_LEA;
+		insn->a = x;
+		insn->b = x;
+		insn->imm = c - 1;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////
+// divide
+////////////////////////////////////////////////////////////////////////////
+
+static int insert_op(BasicBlock *bb, IRInsn *pos, IRFunc *ir, IRKind kind, int a, int b, long imm) {
+	IRInsn *insn = ir_insert_before(bb, pos, kind);
+	insn->dst = ir_new_vreg(ir);
+	insn->a = a;
+	insn->b = b;
+	insn->imm = imm;
+	return insn->dst;
+}
+
+/**
+ * @brief 符号付き64ビットの割り算 x / dを x * m の上位64ビットとシフトsで計算するためのm, sを求める.
+ * Hacker's Delight 10-4 の方法. dは2以上
+ *
+ */
+static void magic(long d, long *m, int *s) {
+	const unsigned long two63 = 1UL << 63;
+	unsigned long ad = d;
+	unsigned long anc = two63 - 1 - two63 % ad;
+	unsigned long q1 = two63 / anc, r1 = two63 - q1 * anc;
+	unsigned long q2 = two63 / ad, r2 = two63 - q2 * ad;
+	unsigned long delta;
+	int p = 63;
+	do {
+		p++;
+		q1 *= 2;
+		r1 *= 2;
+		if (r1 >= anc) {
+			q1++;
+			r1 -= anc;
+		}
+		q2 *= 2;
+		r2 *= 2;
+		if (r2 >= ad) {
+			q2++;
+			r2 -= ad;
+		}
+		delta = ad - r2;
+	} while (q1 < delta || (q1 == delta && r1 == 0));
+	*m = (long)(q2 + 1);
+	*s = p - 64;
+}
+
+/**
+ * @brief 定数での割り算をidivを使わない命令列にする. 結果は0への切り捨て.
+ * 2の冪なら負の数のときだけ d-1 を足してから算術シフト、それ以外は掛け算の上位ビットを使う
+ *
+ */
+static void reduce_div(IRFunc *ir, BasicBlock *bb, IRInsn *insn) {
+	long d;
+	if (!const_of(insn->b, &d) || d == 0) return;
+	int x = insn->a;
+	if (d == 1) {
+		set_unary(insn, IR_MOV, x, 0);
+		return;
+	}
+	long ad = d < 0 ? -d : d;
+	int q;
+	int k = log2_of(ad);
+	if (ad == 1) {
+		q = x;
+	} else if (k > 0) {
+		// x < 0 なら 2^k - 1 を足す
+		int sign = k == 1 ? x : insert_op(bb, insn, ir, IR_SAR, x, 0, 63);
+		int bias = insert_op(bb, insn, ir, IR_SHR, sign, 0, 64 - k);
+		int sum = insert_op(bb, insn, ir, IR_ADD, x, bias, 0);
+		if (d > 0) {
+			set_unary(insn, IR_SAR, sum, k);
+			return;
+		}
+		q = insert_op(bb, insn, ir, IR_SAR, sum, 0, k);
+	} else {
+		long m;
+		int s;
+		magic(ad, &m, &s);
+		int mv = insert_op(bb, insn, ir, IR_IMM, 0, 0, m);
+		int hi = insert_op(bb, insn, ir, IR_MULHI, x, mv, 0);
+		if (m < 0) hi = insert_op(bb, insn, ir, IR_ADD, hi, x, 0);
+		if (s > 0) hi = insert_op(bb, insn, ir, IR_SAR, hi, 0, s);
+		// x < 0 なら1を足して0への切り捨てにする
+		int sign = insert_op(bb, insn, ir, IR_SHR, x, 0, 63);
+		if (d > 0) {
+			insn->kind = IR_ADD;
+			insn->a = hi;
+			insn->b = sign;
+			return;
+		}
+		q = insert_op(bb, insn, ir, IR_ADD, hi, sign, 0);
+	}
+	// 負の数で割るときは符号を反転する
+	insn->kind = IR_SUB;
+	insn->a = insert_op(bb, insn, ir, IR_IMM, 0, 0, 0);
+	insn->b = q;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// address
+////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief 直前の命令で作った p + (i << k) の i << k を、lea dst, [p+i*2^k]の形にまとめる.
+ * 直前の命令に限るのは、その間にiが書き換えられていないことを保証するため
+ *
+ */
+static void fuse_lea(BasicBlock *bb, IRInsn *insn) {
+	IRInsn *prev = insn->prev;
+	if (prev == NULL || prev->dst == 0 || use_count[prev->dst] != 1 || def_count[prev->dst] != 1) return;
+	int base;
+	if (insn->b == prev->dst) base = insn->a;
+	else if (insn->a == prev->dst) base = insn->b;
+	else return;
+	if (base == prev->dst) return;
+
+	if (prev->kind == IR_MOV) {
+		// charの配列では要素の大きさが1なので、そのまま足せばよい
+		insn->a = base;
+		insn->b = prev->a;
+	} else if (prev->kind == IR_SHL && prev->imm <= 3) {
+		insn->kind = IR_LEA;
+		insn->a = base;
+		insn->b = prev->a;
+		insn->imm = 1L << prev->imm;
+	} else return;
+	use_count[prev->dst] = 0;
+	ir_remove(bb, prev);
+}
+
+/**
+ * @brief 掛け算、割り算、ポインタの加算を安い命令に置き換える
+ *
+ * @param ir
+ */
+void ir_reduce(IRFunc *ir) {
+	count_defs_uses(ir);
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) {
+		for (IRInsn *insn = bb->head; insn; insn = insn->next) {
+			if (insn->kind == IR_MUL) reduce_mul(insn);
+			else if (insn->kind == IR_DIV) reduce_div(ir, bb, insn);
+		}
+	}
+	count_defs_uses(ir);
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) {
+		for (IRInsn *insn = bb->head; insn; insn = insn->next) {
+			if (insn->kind == IR_ADD) fuse_lea(bb, insn);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////
+// dead code elimination
+////////////////////////////////////////////////////////////////////////////
+
+// 結果を使わなければ消してよい命令
+static bool is_removable(IRInsn *insn) {
+	switch (insn->kind)
+	{
+	case IR_STORE:
+	case IR_CALL:
+	case IR_JMP:
+	case IR_BR:
+	case IR_RET:
+		return false;
+	default:
+		return insn->dst != 0;
+	}
+}
+
+/**
+ * @brief 結果がどこからも使われない命令を消す. 後ろから見るので、使われない計算の連鎖は1回でほぼ消える
+ *
+ * @param ir
+ */
+void ir_dce(IRFunc *ir) {
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		count_defs_uses(ir);
+		BasicBlock **order = malloc(sizeof(BasicBlock *) * ir->block_count);
+		if (order == NULL) error("out of memory (reduce)\n");
+		int nb = 0;
+		for (BasicBlock *bb = ir->entry; bb; bb = bb->next) order[nb++] = bb;
+		for (int b = nb - 1; b >= 0; b--) {
+			IRInsn *prev;
+			for (IRInsn *insn = order[b]->tail; insn; insn = prev) {
+				prev = insn->prev;
+				if (!is_removable(insn) || use_count[insn->dst] > 0) continue;
+				int uses[MAX_ARGS];
+				int n = ir_uses(insn, uses);
+				for (int i = 0; i < n; i++) use_count[uses[i]]--;
+				ir_remove(order[b], insn);
+				changed = true;
+			}
+		}
+		free(order);
+	}
+}
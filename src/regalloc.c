@@ -0,0 +1,303 @@
+/**
+ * @file regalloc.c
+ * @author Takamasa Naruse
+ * @brief linear-scan register allocation over the IR
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "SverigeCC.h"
+#include <limits.h>
+
+// 割り当てに使う物理レジスタ. rax, r11, rdxは命令を出力するときの作業用に空けておく
+char *reg_name[REG_COUNT] = {"r10", "rdi", "rsi", "rcx", "r8", "r9", "rbx", "r12", "r13", "r14", "r15"};
+char *reg_name8[REG_COUNT] = {"r10b", "dil", "sil", "cl", "r8b", "r9b", "bl", "r12b", "r13b", "r14b", "r15b"};
+bool reg_callee_saved[REG_COUNT] = {false, false, false, false, false, false, true, true, true, true, true};
+
+// 引数を渡すのに使うレジスタ(rdi, rsi, rcx, r8, r9)とcallee-savedのレジスタの範囲
+#define ARG_REG_BEGIN 1
+#define ARG_REG_END 6
+#define CALLEE_SAVED_BEGIN 6
+
+// 各レジスタで渡される引数の番号. 引数レジスタでなければ-1
+static int arg_index[REG_COUNT] = {-1, 0, 1, 3, 4, 5, -1, -1, -1, -1, -1};
+
+/**
+ * @brief 生存区間. 命令の番号で[start, end]
+ *
+ */
+typedef struct {
+	int vreg;
+	int start;
+	int end;
+} Interval;
+
+// 位置を番号順に並べたもの. callの位置
+typedef struct {
+	int *pos;
+	int len;
+} PosList;
+
+static void pos_push(PosList *list, int pos, int cap) {
+	if (list->pos == NULL) list->pos = malloc(sizeof(int) * cap);
+	if (list->pos == NULL) error("out of memory (regalloc)\n");
+	list->pos[list->len++] = pos;
+}
+
+// posより大きい最初の位置
+static int pos_after(PosList *list, int pos) {
+	int lo = 0, hi = list->len;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (list->pos[mid] <= pos) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+// (start, end)の間にlistの位置があるか. inclusiveなら両端も含める
+static bool overlaps(PosList *list, Interval *it, bool inclusive) {
+	int i = pos_after(list, inclusive ? it->start - 1 : it->start);
+	if (i == list->len) return false;
+	return inclusive ? list->pos[i] <= it->end : list->pos[i] < it->end;
+}
+
+static int cmp_start(const void *a, const void *b) {
+	const Interval *x = a, *y = b;
+	if (x->start != y->start) return x->start < y->start ? -1 : 1;
+	return x->vreg - y->vreg;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// liveness
+////////////////////////////////////////////////////////////////////////////
+
+// ブロックをまたいで生きる仮想レジスタの集合. globalの番号でビットを立てる
+typedef unsigned long long Bits;
+#define BITS_PER 64
+
+static bool bits_has(Bits *set, int i) {
+	return set[i / BITS_PER] >> (i % BITS_PER) & 1;
+}
+
+static void bits_set(Bits *set, int i) {
+	set[i / BITS_PER] |= 1ULL << (i % BITS_PER);
+}
+
+static void update(Interval *it, int pos) {
+	if (pos < it->start) it->start = pos;
+	if (pos > it->end) it->end = pos;
+}
+
+/**
+ * @brief 各仮想レジスタの生存区間を求める. ブロック内で閉じた一時的な値は定義と使用の位置だけで決まるので、
+ * ブロックをまたぐ値(変数など)だけデータフロー解析で生存ブロックを求めて区間を広げる
+ *
+ */
+static void build_intervals(IRFunc *ir, Interval *its, PosList *calls, int *param_pos) {
+	int nv = ir->vreg_count + 1;
+	int *def_block = malloc(sizeof(int) * nv);
+	int *global = malloc(sizeof(int) * nv);
+	int *block_start = malloc(sizeof(int) * ir->block_count);
+	int *block_end = malloc(sizeof(int) * ir->block_count);
+	if (!def_block || !global || !block_start || !block_end) error("out of memory (regalloc)\n");
+	for (int v = 0; v < nv; v++) {
+		def_block[v] = -1;
+		global[v] = -1;
+		its[v].vreg = v;
+		its[v].start = INT_MAX;
+		its[v].end = -1;
+	}
+
+	// 命令に番号を振って、定義と使用の位置で区間を広げる
+	int pos = 0, insn_count = 0;
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) {
+		for (IRInsn *insn = bb->head; insn; insn = insn->next) insn_count++;
+	}
+	int global_count = 0;
+	for (BasicBlock *bb = ir->entry; bb; bb = bb->next) {
+		block_start[bb->id] = pos;
+		for (IRInsn *insn = bb->head; insn; insn = insn->next) {
+			int uses[MAX_ARGS];
+			int n = ir_uses(insn, uses);
+			for (int i = 0; i < n; i++) {
+				update(&its[uses[i]], pos);
+				if (def_block[uses[i]] != bb->id && global[uses[i]] < 0) global[uses[i]] = global_count++;
+			}
+			// 末尾呼び出しの後に生きる値はないが、引数を並べるところは呼び出しと同じ
+			if (insn->kind == IR_CALL || insn->kind == IR_TAILCALL) pos_push(calls, pos, insn_count);
+			if (insn->kind == IR_PARAM) param_pos[insn->imm] = pos;
+			if (insn->dst) {
+				update(&its[insn->dst], pos);
+				if (def_block[insn->dst] < 0) def_block[insn->dst] = bb->id;
+				else if (def_block[insn->dst] != bb->id && global[insn->dst] < 0) global[insn->dst] = global_count++;
+			}
+			pos += 2;
+		}
+		block_end[bb->id] = pos - 2;
+	}
+
+	if (global_count > 0) {
+		// live_in = use ∪ (live_out - def), live_out = ∪ live_in(succ)
+		int words = (global_count + BITS_PER - 1) / BITS_PER;
+		Bits *sets = calloc((size_t)ir->block_count * words * 4, sizeof(Bits));
+		if (sets == NULL) error("out of memory (regalloc)\n");
+		Bits *use = sets, *def = sets + (size_t)ir->block_count * words;
+		Bits *in = def + (size_t)ir->block_count * words, *out = in + (size_t)ir->block_count * words;
+		BasicBlock **order = malloc(sizeof(BasicBlock *) * ir->block_count);
+		if (order == NULL) error("out of memory (regalloc)\n");
+		int nb = 0;
+		for (BasicBlock *bb = ir->entry; bb; bb = bb->next) {
+			order[nb++] = bb;
+			Bits *u = use + (size_t)bb->id * words, *d = def + (size_t)bb->id * words;
+			for (IRInsn *insn = bb->head; insn; insn = insn->next) {
+				int uses[MAX_ARGS];
+				int n = ir_uses(insn, uses);
+				for (int i = 0; i < n; i++) {
+					int g = global[uses[i]];
+					if (g >= 0 && !bits_has(d, g)) bits_set(u, g);
+				}
+				if (insn->dst && global[insn->dst] >= 0) bits_set(d, global[insn->dst]);
+			}
+		}
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			// 後ろ向きの解析なので、出力順の逆にたどると早く収束する
+			for (int b = nb - 1; b >= 0; b--) {
+				BasicBlock *bb = order[b];
+				Bits *o = out + (size_t)bb->id * words, *i = in + (size_t)bb->id * words;
+				BasicBlock *succs[2];
+				int n = ir_succs(bb, succs);
+				for (int s = 0; s < n; s++) {
+					Bits *si = in + (size_t)succs[s]->id * words;
+					for (int w = 0; w < words; w++) o[w] |= si[w];
+				}
+				Bits *u = use + (size_t)bb->id * words, *d = def + (size_t)bb->id * words;
+				for (int w = 0; w < words; w++) {
+					Bits nw = u[w] | (o[w] & ~d[w]);
+					if (nw != i[w]) {
+						i[w] = nw;
+						changed = true;
+					}
+				}
+			}
+		}
+		int *vreg_of = malloc(sizeof(int) * global_count);
+		if (vreg_of == NULL) error("out of memory (regalloc)\n");
+		for (int v = 0; v < nv; v++) {
+			if (global[v] >= 0) vreg_of[global[v]] = v;
+		}
+		for (BasicBlock *bb = ir->entry; bb; bb = bb->next) {
+			Bits *o = out + (size_t)bb->id * words, *i = in + (size_t)bb->id * words;
+			for (int g = 0; g < global_count; g++) {
+				if (bits_has(i, g)) update(&its[vreg_of[g]], block_start[bb->id]);
+				if (bits_has(o, g)) update(&its[vreg_of[g]], block_end[bb->id]);
+			}
+		}
+		free(vreg_of);
+		free(order);
+		free(sets);
+	}
+	free(def_block);
+	free(global);
+	free(block_start);
+	free(block_end);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// linear scan
+////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief 区間itをレジスタregに置いてよいか
+ *
+ * @param param_pos 各引数を受け取るparamの位置(-1ならない)
+ */
+static bool allowed(int reg, Interval *it, PosList *calls, int *param_pos) {
+	// callをまたいで生きる値はcallee-savedのレジスタにしか置けない
+	if (overlaps(calls, it, false)) return reg >= CALLEE_SAVED_BEGIN;
+	if (ARG_REG_BEGIN <= reg && reg < ARG_REG_END) {
+		// 引数を並べる途中で上書きされないよう、callに触れる値は引数レジスタに置かない
+		if (overlaps(calls, it, true)) return false;
+		// そのレジスタで来た引数を受け取るより前から使うと、引数を壊してしまう.
+		// 受け取るparamの位置から始まる区間は、その引数自身
+		int p = param_pos[arg_index[reg]];
+		if (p >= 0 && it->start < p) return false;
+	}
+	return true;
+}
+
+/**
+ * @brief 線形走査法でir->regを決める. 空いているレジスタがなければ、
+ * 一番遠くまで生きる区間をスタックに追い出す
+ *
+ * @param ir
+ */
+void regalloc(IRFunc *ir) {
+	int nv = ir->vreg_count + 1;
+	ir->reg = arena_alloc(&node_arena, sizeof(int) * nv);
+	Interval *its = malloc(sizeof(Interval) * nv);
+	if (its == NULL) error("out of memory (regalloc)\n");
+	PosList calls = {NULL, 0};
+	int param_pos[MAX_ARGS];
+	for (int i = 0; i < MAX_ARGS; i++) param_pos[i] = -1;
+	build_intervals(ir, its, &calls, param_pos);
+
+	// 引数は受け取ったレジスタにそのまま置けるなら置く
+	int *hint = malloc(sizeof(int) * nv);
+	if (hint == NULL) error("out of memory (regalloc)\n");
+	for (int v = 0; v < nv; v++) hint[v] = -1;
+	for (IRInsn *insn = ir->entry->head; insn; insn = insn->next) {
+		if (insn->kind != IR_PARAM) continue;
+		for (int r = ARG_REG_BEGIN; r < ARG_REG_END; r++) {
+			if (arg_index[r] == insn->imm) hint[insn->dst] = r;
+		}
+	}
+
+	int count = 0;
+	for (int v = 1; v < nv; v++) {
+		ir->reg[v] = -1;
+		if (its[v].end >= 0) its[count++] = its[v];
+	}
+	qsort(its, count, sizeof(Interval), cmp_start);
+
+	// 今レジスタを持っている区間. 各レジスタを持つ区間の番号(-1なら空き)
+	int owner[REG_COUNT];
+	for (int r = 0; r < REG_COUNT; r++) owner[r] = -1;
+
+	for (int i = 0; i < count; i++) {
+		Interval *it = &its[i];
+		// 終わった区間のレジスタを空ける
+		for (int r = 0; r < REG_COUNT; r++) {
+			if (owner[r] >= 0 && its[owner[r]].end < it->start) owner[r] = -1;
+		}
+		int reg = -1;
+		int h = hint[it->vreg];
+		if (h >= 0 && owner[h] < 0 && allowed(h, it, &calls, param_pos)) reg = h;
+		for (int r = 0; r < REG_COUNT && reg < 0; r++) {
+			if (owner[r] < 0 && allowed(r, it, &calls, param_pos)) reg = r;
+		}
+		if (reg < 0) {
+			// 使えるレジスタを持つ区間のうち、一番遠くまで生きるものと比べて追い出す方を決める
+			int victim = -1;
+			for (int r = 0; r < REG_COUNT; r++) {
+				if (!allowed(r, it, &calls, param_pos)) continue;
+				if (victim < 0 || its[owner[r]].end > its[owner[victim]].end) victim = r;
+			}
+			if (victim < 0 || its[owner[victim]].end <= it->end) continue;
+			// 追い出す区間はそのレジスタを使える区間なので、この区間の途中に別のレジスタへ移すことはない
+			ir->reg[its[owner[victim]].vreg] = -1;
+			reg = victim;
+		}
+		owner[reg] = i;
+		ir->reg[it->vreg] = reg;
+	}
+
+	free(calls.pos);
+	free(hint);
+	free(its);
+}
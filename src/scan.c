@@ -0,0 +1,202 @@
+/**
+ * @file scan.c
+ * @author Takamasa Naruse
+ * @brief character-run scanners for the tokenizer (scalar / SSE2 / AVX2)
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "SverigeCC.h"
+
+#ifdef __x86_64__
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+char *(*skip_space)(char *p, char *end);
+char *(*scan_ident)(char *p, char *end);
+char *(*scan_digits)(char *p, char *end);
+
+// localeに依存しないように自前で判定する
+static bool is_space_c(char c) {
+	return c == ' ' || ('\t' <= c && c <= '\r');
+}
+
+static bool is_ident_c(char c) {
+	return ('a' <= (c | 0x20) && (c | 0x20) <= 'z') || ('0' <= c && c <= '9') || c == '_';
+}
+
+static bool is_digit_c(char c) {
+	return '0' <= c && c <= '9';
+}
+
+////////////////////////////////////////////////////////////////////////////
+// scalar
+////////////////////////////////////////////////////////////////////////////
+
+static char *skip_space_scalar(char *p, char *end) {
+	while (p < end && is_space_c(*p)) p++;
+	return p;
+}
+
+static char *scan_ident_scalar(char *p, char *end) {
+	while (p < end && is_ident_c(*p)) p++;
+	return p;
+}
+
+static char *scan_digits_scalar(char *p, char *end) {
+	while (p < end && is_digit_c(*p)) p++;
+	return p;
+}
+
+#ifdef SCAN_X86
+////////////////////////////////////////////////////////////////////////////
+// SSE2 (16バイトずつ)
+// 各関数は「条件を満たす文字」のビットマスクを作り、最初の0のビットを探す
+////////////////////////////////////////////////////////////////////////////
+
+static inline __m128i in_range16(__m128i c, char lo, char hi) {
+	// 対象の文字はすべて0x80未満なので、符号付きの比較でよい
+	return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8(hi + 1)));
+}
+
+static inline unsigned space_mask16(__m128i c) {
+	__m128i sp = _mm_cmpeq_epi8(c, _mm_set1_epi8(' '));
+	return _mm_movemask_epi8(_mm_or_si128(sp, in_range16(c, '\t', '\r')));
+}
+
+static inline unsigned ident_mask16(__m128i c) {
+	__m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+	__m128i m = _mm_or_si128(in_range16(lower, 'a', 'z'), in_range16(c, '0', '9'));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(c, _mm_set1_epi8('_')));
+	return _mm_movemask_epi8(m);
+}
+
+static inline unsigned digit_mask16(__m128i c) {
+	return _mm_movemask_epi8(in_range16(c, '0', '9'));
+}
+
+static char *skip_space_sse2(char *p, char *end) {
+	// 1文字で終わることが多いので、先に1文字だけ見る
+	if (p == end || !is_space_c(*p)) return p;
+	while (end - p >= 16) {
+		unsigned m = ~space_mask16(_mm_loadu_si128((__m128i *)p)) & 0xffff;
+		if (m) return p + __builtin_ctz(m);
+		p += 16;
+	}
+	return skip_space_scalar(p, end);
+}
+
+static char *scan_ident_sse2(char *p, char *end) {
+	// 1文字で終わることが多いので、先に1文字だけ見る
+	if (p == end || !is_ident_c(*p)) return p;
+	while (end - p >= 16) {
+		unsigned m = ~ident_mask16(_mm_loadu_si128((__m128i *)p)) & 0xffff;
+		if (m) return p + __builtin_ctz(m);
+		p += 16;
+	}
+	return scan_ident_scalar(p, end);
+}
+
+static char *scan_digits_sse2(char *p, char *end) {
+	// 1文字で終わることが多いので、先に1文字だけ見る
+	if (p == end || !is_digit_c(*p)) return p;
+	while (end - p >= 16) {
+		unsigned m = ~digit_mask16(_mm_loadu_si128((__m128i *)p)) & 0xffff;
+		if (m) return p + __builtin_ctz(m);
+		p += 16;
+	}
+	return scan_digits_scalar(p, end);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// AVX2 (32バイトずつ). CPUが対応しているときだけ使う
+////////////////////////////////////////////////////////////////////////////
+
+#define AVX2 __attribute__((target("avx2")))
+
+static inline AVX2 __m256i in_range32(__m256i c, char lo, char hi) {
+	return _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8(lo - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), c));
+}
+
+static inline AVX2 unsigned space_mask32(__m256i c) {
+	__m256i sp = _mm256_cmpeq_epi8(c, _mm256_set1_epi8(' '));
+	return _mm256_movemask_epi8(_mm256_or_si256(sp, in_range32(c, '\t', '\r')));
+}
+
+static inline AVX2 unsigned ident_mask32(__m256i c) {
+	__m256i lower = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+	__m256i m = _mm256_or_si256(in_range32(lower, 'a', 'z'), in_range32(c, '0', '9'));
+	m = _mm256_or_si256(m, _mm256_cmpeq_epi8(c, _mm256_set1_epi8('_')));
+	return _mm256_movemask_epi8(m);
+}
+
+static inline AVX2 unsigned digit_mask32(__m256i c) {
+	return _mm256_movemask_epi8(in_range32(c, '0', '9'));
+}
+
+static AVX2 char *skip_space_avx2(char *p, char *end) {
+	if (p == end || !is_space_c(*p)) return p;
+	while (end - p >= 32) {
+		unsigned m = ~space_mask32(_mm256_loadu_si256((__m256i *)p));
+		if (m) return p + __builtin_ctz(m);
+		p += 32;
+	}
+	return skip_space_sse2(p, end);
+}
+
+static AVX2 char *scan_ident_avx2(char *p, char *end) {
+	if (p == end || !is_ident_c(*p)) return p;
+	while (end - p >= 32) {
+		unsigned m = ~ident_mask32(_mm256_loadu_si256((__m256i *)p));
+		if (m) return p + __builtin_ctz(m);
+		p += 32;
+	}
+	return scan_ident_sse2(p, end);
+}
+
+static AVX2 char *scan_digits_avx2(char *p, char *end) {
+	if (p == end || !is_digit_c(*p)) return p;
+	while (end - p >= 32) {
+		unsigned m = ~digit_mask32(_mm256_loadu_si256((__m256i *)p));
+		if (m) return p + __builtin_ctz(m);
+		p += 32;
+	}
+	return scan_digits_sse2(p, end);
+}
+#endif
+
+/**
+ * @brief 使う実装を選ぶ. SCAN_AUTOならCPUIDを見て一番速いものにする.
+ * 指定された実装をCPUが持っていなければ, 一段ずつ下げる
+ *
+ * @param level
+ * @return ScanLevel 実際に選ばれた実装
+ */
+ScanLevel scan_init(ScanLevel level) {
+#ifdef SCAN_X86
+	__builtin_cpu_init();
+	if (level == SCAN_AUTO) level = SCAN_AVX2;
+	if (level == SCAN_AVX2 && !__builtin_cpu_supports("avx2")) level = SCAN_SSE2;
+	if (level == SCAN_SSE2 && !__builtin_cpu_supports("sse2")) level = SCAN_SCALAR;
+	if (level == SCAN_AVX2) {
+		skip_space = skip_space_avx2;
+		scan_ident = scan_ident_avx2;
+		scan_digits = scan_digits_avx2;
+		return SCAN_AVX2;
+	}
+	if (level == SCAN_SSE2) {
+		skip_space = skip_space_sse2;
+		scan_ident = scan_ident_sse2;
+		scan_digits = scan_digits_sse2;
+		return SCAN_SSE2;
+	}
+#endif
+	skip_space = skip_space_scalar;
+	scan_ident = scan_ident_scalar;
+	scan_digits = scan_digits_scalar;
+	return SCAN_SCALAR;
+}
@@ -0,0 +1,158 @@
+/**
+ * @file symtab.c
+ * @author Takamasa Naruse
+ * @brief open-addressing symbol table with nested scopes
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "SverigeCC.h"
+
+#define SYMTAB_INIT_CAP 64
+
+static unsigned hash_id(int id) {
+	// Fibonacci hashing. 連番のidが散らばるようにする
+	return (unsigned)id * 2654435769u >> 7;
+}
+
+/**
+ * @brief idが入っているスロット、なければ入るべき空きスロットを返す
+ *
+ */
+static SymSlot *probe(SymTab *tab, int id) {
+	unsigned mask = tab->cap - 1;
+	for (unsigned i = hash_id(id) & mask; ; i = (i + 1) & mask) {
+		SymSlot *slot = &tab->slots[i];
+		if (slot->val == NULL || slot->id == id) return slot;
+	}
+}
+
+static void grow(SymTab *tab) {
+	SymSlot *old = tab->slots;
+	int old_cap = tab->cap;
+	tab->cap = old_cap ? old_cap * 2 : SYMTAB_INIT_CAP;
+	tab->slots = calloc(tab->cap, sizeof(SymSlot));
+	if (tab->slots == NULL) error("out of memory (symtab)\n");
+	for (int i = 0; i < old_cap; i++) {
+		if (old[i].val == NULL) continue;
+		*probe(tab, old[i].id) = old[i];
+	}
+	free(old);
+}
+
+/**
+ * @brief 線形探索法の後方シフト削除. tombstoneを使わずにスロットを空ける
+ *
+ */
+static void remove_slot(SymTab *tab, SymSlot *slot) {
+	unsigned mask = tab->cap - 1;
+	unsigned i = slot - tab->slots;
+	unsigned j = i;
+	for (;;) {
+		tab->slots[i].val = NULL;
+		for (;;) {
+			j = (j + 1) & mask;
+			if (tab->slots[j].val == NULL) {
+				tab->count--;
+				return;
+			}
+			unsigned home = hash_id(tab->slots[j].id) & mask;
+			// homeが(i, j]の外にあるなら、jの要素をiに詰められる
+			if (i <= j ? (home <= i || j < home) : (home <= i && j < home)) break;
+		}
+		tab->slots[i] = tab->slots[j];
+		i = j;
+	}
+}
+
+/**
+ * @brief 識別子idに対応する値を探す. なければNULL
+ *
+ * @param tab
+ * @param id internで得た識別子の番号
+ * @return void*
+ */
+void *symtab_find(SymTab *tab, int id) {
+	if (tab->count == 0) return NULL;
+	return probe(tab, id)->val;
+}
+
+/**
+ * @brief 今のスコープで宣言されたidに対応する値を探す. なければNULL
+ *
+ */
+void *symtab_find_in_scope(SymTab *tab, int id) {
+	if (tab->count == 0) return NULL;
+	SymSlot *slot = probe(tab, id);
+	if (slot->val == NULL || slot->depth != tab->depth) return NULL;
+	return slot->val;
+}
+
+/**
+ * @brief 今のスコープにidを登録する. 外側のスコープの同名の値は隠れる
+ *
+ * @param tab
+ * @param id
+ * @param val NULLは不可
+ */
+void symtab_add(SymTab *tab, int id, void *val) {
+	if ((tab->count + 1) * 4 > tab->cap * 3) grow(tab);
+	SymSlot *slot = probe(tab, id);
+
+	if (tab->undo_len == tab->undo_cap) {
+		tab->undo_cap = tab->undo_cap ? tab->undo_cap * 2 : SYMTAB_INIT_CAP;
+		tab->undo = realloc(tab->undo, tab->undo_cap * sizeof(SymSlot));
+		if (tab->undo == NULL) error("out of memory (symtab)\n");
+	}
+	SymSlot *undo = &tab->undo[tab->undo_len++];
+	undo->id = id;
+	undo->val = slot->val;
+	undo->depth = slot->depth;
+
+	if (slot->val == NULL) tab->count++;
+	slot->id = id;
+	slot->val = val;
+	slot->depth = tab->depth;
+}
+
+void symtab_push_scope(SymTab *tab) {
+	if (tab->depth == tab->mark_cap) {
+		tab->mark_cap = tab->mark_cap ? tab->mark_cap * 2 : 16;
+		tab->marks = realloc(tab->marks, tab->mark_cap * sizeof(int));
+		if (tab->marks == NULL) error("out of memory (symtab)\n");
+	}
+	tab->marks[tab->depth++] = tab->undo_len;
+}
+
+static void undo_to(SymTab *tab, int mark) {
+	while (tab->undo_len > mark) {
+		SymSlot *undo = &tab->undo[--tab->undo_len];
+		SymSlot *slot = probe(tab, undo->id);
+		if (undo->val) {
+			// 外側のスコープの値に戻す
+			slot->val = undo->val;
+			slot->depth = undo->depth;
+		} else remove_slot(tab, slot);
+	}
+}
+
+/**
+ * @brief 直近のsymtab_push_scope以降に登録した名前を全部取り消す
+ *
+ */
+void symtab_pop_scope(SymTab *tab) {
+	if (tab->depth == 0) error("symtab: scope underflow\n");
+	undo_to(tab, tab->marks[--tab->depth]);
+}
+
+/**
+ * @brief 登録した名前を全部取り消す. 確保した領域は再利用する
+ *
+ */
+void symtab_clear(SymTab *tab) {
+	undo_to(tab, 0);
+	tab->depth = 0;
+}
@@ -13,7 +13,8 @@ try() {
   expected="$1"
   input="$2"
 
-  ./SverigeCC "$input" > tmp.s
+  echo "$input" > tmp.c
+  ./SverigeCC $SVCC_FLAGS tmp.c
   #gcc -o tmp tmp.s
   gcc -static -o tmp tmp.s tmp2.o
 	echo output ./tmp
@@ -124,6 +125,9 @@ try 3 'int main() { if (0) return 2; return 3; }'
 try 3 'int main() { if (1-1) return 2; return 3; }'
 try 2 'int main() { if (1) return 2; return 3; }'
 try 2 'int main() { if (2-1) return 2; return 3; }'
+try 3 'int main() { if (0) return 2; else return 3; }'
+try 2 'int main() { if (1) return 2; else return 3; }'
+try 7 'int main() { int x=5; if (x<3) return 2; else if (x<6) { if (x==5) return 7; } return 3; }'
 
 try 3 'int main() { {1; {2;} return 3;} }'
 
@@ -143,6 +147,7 @@ try 32 'int main() { return ret32(); } int ret32() { return 32; }'
 try 7 'int main() { return add2(3,4); } int add2(int x, int y) { return x+y; }'
 try 1 'int main() { return sub2(4,3); } int sub2(int x, int y) { return x-y; }'
 try 55 'int main() { return fib(9); } int fib(int x) { if (x<=1) return 1; return fib(x-1) + fib(x-2); }'
+try 7 'int main() { int x=0; { x=sub2(9,2); ; } return x; } int sub2(int x, int y) { return x-y; }'
 
 try 3 'int main() { int x=3; return *&x; }'
 try 3 'int main() { int x=3; int *y=&x; int **z=&y; return **z; }'
@@ -155,5 +160,95 @@ try 3 'int main() { int x=3; int y=5; int *z=&y; return *(z-1); }'
 try 5 'int main() { int x=3; int *y=&x; *y=5; return x; }'
 try 7 'int main() { int x=3; int y=5; *(&x+1)=7; return y; }'
 try 7 'int main() { int x=3; int y=5; *(&y-1)=7; return x; }'
+try 4 'int main() { int x=3; if (2-2) return 1; while (0) x=9; for (;1;) return x+1; }'
+try 5 'int main() { int x=5; int y; y=x*1+0-(x-x)+x*0; return y/1; }'
+try 2 'int main() { char x[3]; x[0]=1; x[1]=2; char *p=x; return *(p+1); }'
+try 12 'int main() { int x=0-100; int y=7; return (x/7+14)*(x/(0-3)-y*3) + x/4 + 25 + 100/(y/y*8) + (x/(0-1)-100); }'
+try 34 'int main() { int i; int s=0; for (i=0; 10>i; i=i+1) { if (i!=3) s=s+1; if (i>=8) s=s+10; if (i<=1) s=s+2; if (i==9) s=s+1; } return s; }'
+try 7 'int main() { return sub3(9, 2); } int sub3(int a, char b) { return a-b; }'
+try 26 'int sq(int x) { return x*x; } int add3(int a, int b, int c) { return a+b+c; } int arr(int n) { int a[4]; a[0]=n; a[3]=n+1; return a[0]+a[3]; } int main() { return sq(3) + add3(1,2,3) + arr(5); }'
+try 40 'int sq(int x) { return x*x; } int inc(int x) { return x+1; } int twice(int x) { return sq(x)+sq(x); } int main() { int y=3; int a[2]; a[1]=2; return sq(3)+inc(sq(y))+twice(y)+inc(a[1]); }'
+try 45 'int g[20]; int fill(int *x, int n) { int i; for (i=0; i<n; i=i+1) x[i] = i*3; return 0; } int main() { int i; int j; int s=0; fill(g, 20); for (i=0; i<4; i=i+1) for (j=0; j<5; j=j+1) s = s + g[i*5+j] - g[j]; return s/10; }'
+# 実引数の代入や呼び出しは、展開した式がグローバル変数を読むより先に起きる
+if [ -n "$SVCC_FLAGS" ]; then
+  try 10 'int G; int f(int a) { return G+a; } int main() { G=1; return f(G=5); }'
+  try 12 'int G; int f(int a) { return G+a; } int bump() { G=G+10; return 1; } int main() { G=1; return f(bump()); }'
+fi
+try 21 'int swap(int a, int b, int k) { if (k == 0) return a*10+b; return swap(b, a, k-1); } int main() { return swap(1, 2, 3); }'
+# 末尾呼び出しはループになるので、-O1なら深く再帰してもスタックを使わない
+if [ -n "$SVCC_FLAGS" ]; then
+  try 12 'int down(int n) { if (n == 0) return 7; return down(n-1); } int sum(int n, int acc) { if (n == 0) return acc; return sum(n-1, acc+n); } int two(int n) { return down(n); } int main() { return (sum(10000000, 0) == 5000000 * 10000001) * 5 + two(10000000); }'
+fi
+try 127 'int main() { int a=1; int b=2; int c=3; int d=4; int e=5; int f=6; int g=7; int h=8; int i=9; int j=10; int k=11; int l=12; int s=add(a,b); int t=add(add(c,d), add(e, add(f, g))); int q=(a+b)*(c+d)-(e*f)/(g-h+(i*j)); return a+b+c+d+e+f+g+h+i+j+k+l+s+t+q; }'
+
+try_files() {
+  expected="$1"
+  shift
+
+  ./SverigeCC $SVCC_FLAGS "$@"
+  gcc -static -o tmp "${@/%.c/.s}" tmp2.o
+  ./tmp
+  actual="$?"
+
+  if [ "$actual" = "$expected" ]; then
+    echo "$* => $actual"
+  else
+    echo "$* => $expected expected, but got $actual"
+    exit 1
+  fi
+}
+echo 'int ret7() { return 7; } int x;' > tmp_a.c
+echo 'int main() { return ret7() + add(1, 2); } int x;' > tmp_b.c
+try_files 10 tmp_a.c tmp_b.c
+
+# 長い文の並びと左に深い式を小さいスタックで通す
+{
+  echo 'int main() { int x; x=0;'
+  for i in $(seq 20000); do echo 'x=x+1;'; done
+  echo 'return 1'
+  for i in $(seq 50000); do echo '+1'; done
+  echo '- x; }'
+} > tmp_deep.c
+(ulimit -s 256; ./SverigeCC $SVCC_FLAGS tmp_deep.c) || exit 1
+try_files 49 tmp_deep.c
+
+# --dump-irは関数ごとのIRを標準エラーに書き出す
+echo 'int sq(int x) { return x*x; } int main() { int x; x=3; return sq(x)+x; }' > tmp.c
+./SverigeCC $SVCC_FLAGS --dump-ir tmp.c > /dev/null 2> tmp_ir.txt || exit 1
+if ! grep -q '^func sq ' tmp_ir.txt || ! grep -q '^func main ' tmp_ir.txt || ! grep -q '^bb0:' tmp_ir.txt; then
+  echo "--dump-ir => missing functions or blocks"
+  exit 1
+fi
+
+# peepholeを外しても同じ結果になり、--peephole-statsは規則ごとの回数を書き出す
+prog='int sq(int x) { return x*x; } int main() { int a; int b; a=3; b=a; a=b; return sq(a)+b; }'
+try 12 "$prog"
+SVCC_FLAGS="$SVCC_FLAGS --no-peephole" try 12 "$prog"
+./SverigeCC $SVCC_FLAGS --peephole-stats tmp.c > /dev/null 2> tmp_stats.txt || exit 1
+for rule in self-move store-load load-store overwritten jump-next zero-reg; do
+  if ! grep -q "^peephole $rule *: [0-9]*$" tmp_stats.txt; then
+    echo "--peephole-stats => no count for $rule"
+    exit 1
+  fi
+done
+
+# --no-inlineでは呼び出しを残したまま同じ結果になる
+prog='int sq(int x) { return x*x; } int main() { return sq(3)+sq(4); }'
+try 25 "$prog"
+if [ -n "$SVCC_FLAGS" ] && grep -q 'call sq' tmp.s; then
+  echo "$prog => sq was not inlined"
+  exit 1
+fi
+SVCC_FLAGS="$SVCC_FLAGS --no-inline" try 25 "$prog"
+if ! grep -q 'call sq' tmp.s; then
+  echo "$prog => sq was inlined with --no-inline"
+  exit 1
+fi
+
+# 最適化を有効にしてもう一度全部通す
+if [ -z "$SVCC_FLAGS" ]; then
+  SVCC_FLAGS="-O1 --check-align" ./test.sh || exit 1
+  exit 0
+fi
 
 echo OK
\ No newline at end of file
@@ -11,223 +11,243 @@
 
 #include "SverigeCC.h"
 
-static const char multi_punct[][10] = {"==", "!=", ">=", "<="};
-static const int multi_punct_len[] = {2, 2, 2, 2};
-static const int multi_punct_size = 4;
-
-static const char control_flow[][10] = {"return", "if", "else", "while", "for"};
-static const int control_flow_len[] = {6, 2, 4, 5, 3};
-static const int control_flow_size = 5;
-
-static const char data_type[][10] = {"int", "char"};
-static const int data_type_len[] = {3, 4};
-static const int data_type_size = 2;
-
-Token *token;
+/**
+ * @brief キーワードの完全ハッシュ表
+ * (末尾の文字 + 長さ) & 15 が全キーワードで衝突しないように選んである.
+ * キーワードを増やしたときは衝突しないハッシュを選び直すこと
+ * 
+ */
+typedef struct {
+	char *name;
+	int len;
+	TokenKind kind;
+} Keyword;
+
+static const Keyword keyword_table[16] = {
+	[4] = {"return", 6, TK_RETURN},
+	[5] = {"for", 3, TK_FOR},
+	[6] = {"char", 4, TK_CHAR},
+	[7] = {"int", 3, TK_INT},
+	[8] = {"if", 2, TK_IF},
+	[9] = {"else", 4, TK_ELSE},
+	[10] = {"while", 5, TK_WHILE},
+	[12] = {"sizeof", 6, TK_SIZEOF},
+};
+
+// エラー表示用
+static char *token_name[] = {
+	[TK_IDENT] = "identifier", [TK_NUM] = "number", [TK_EOF] = "EOF",
+	[TK_PLUS] = "+", [TK_MINUS] = "-", [TK_STAR] = "*", [TK_SLASH] = "/", [TK_AMP] = "&",
+	[TK_ASSIGN] = "=", [TK_EQ] = "==", [TK_NE] = "!=",
+	[TK_LT] = "<", [TK_LE] = "<=", [TK_GT] = ">", [TK_GE] = ">=",
+	[TK_LPAREN] = "(", [TK_RPAREN] = ")", [TK_LBRACE] = "{", [TK_RBRACE] = "}",
+	[TK_LBRACKET] = "[", [TK_RBRACKET] = "]", [TK_SEMI] = ";", [TK_COMMA] = ",",
+	[TK_RETURN] = "return", [TK_IF] = "if", [TK_ELSE] = "else", [TK_WHILE] = "while",
+	[TK_FOR] = "for", [TK_INT] = "int", [TK_CHAR] = "char", [TK_SIZEOF] = "sizeof",
+};
+
+TokenArray tokens;
+int token;
+
+// 次に字句解析する位置
+static char *lex_pos;
+// 入力の終わり. 入力は'\0'で終わっているとは限らないので、ここを越えて読まない
+static char *lex_end;
+
+static void lex_more(void);
 
 void next(void) {
-	token = token->next;
+	token++;
+	if (token == tokens.count) lex_more();
 }
 
-bool consume(char *op) {
-	if (strlen(op) != token->len || memcmp(op, token->str, token->len) != 0) return false;
-	return true;
+bool consume(TokenKind kind) {
+	return tok_kind(token) == kind;
 }
 
-bool consume_nxt(char *op) {
-	if (strlen(op) != token->len || memcmp(op, token->str, token->len) != 0) return false;
+bool consume_nxt(TokenKind kind) {
+	if (tok_kind(token) != kind) return false;
 	next();
 	return true;
 }
 
-void expect_nxt(char *op) {
-	if (strlen(op) != token->len || memcmp(op, token->str, token->len) != 0) 
-		error_at(token->str, "not '%s' -> '%s'(expect)", op, token->str);
+void expect_nxt(TokenKind kind) {
+	if (tok_kind(token) != kind) 
+		error_at(tok_str(token), "not '%s' -> '%.*s'(expect)", token_name[kind], tok_len(token), tok_str(token));
 	next();
 }
 
 int expect_num_nxt(void) {
-	if (token->kind != TK_NUM) error_at(token->str, "not number\n");
-	int res = token->val;
+	if (tok_kind(token) != TK_NUM) error_at(tok_str(token), "not number\n");
+	int res = tok_val(token);
 	next();
 	return res;
 }
 
-Token *consume_ident_nxt(void) {
-	if (token->kind == TK_IDENT) {
-		Token *res = token;
+/**
+ * @brief 識別子なら読み進めてそのトークンの番号を返す. 識別子でなければ-1
+ * 
+ */
+int consume_ident_nxt(void) {
+	if (tok_kind(token) == TK_IDENT) {
+		int res = token;
 		next();
 		return res;
 	}
-	return NULL;
+	return -1;
 }
 
 void expect_ident_nxt(void) {
-	if (token->kind == TK_IDENT) next();
-	else error_at(token->str, "not ident\n");
+	if (tok_kind(token) == TK_IDENT) next();
+	else error_at(tok_str(token), "not ident\n");
 }
 
 void expect_ident(void) {
-	if (token->kind != TK_IDENT) error_at(token->str, "not ident\n");
+	if (tok_kind(token) != TK_IDENT) error_at(tok_str(token), "not ident\n");
 }
 
 bool is_ident(void) {
-	return token->kind == TK_IDENT;
-}
-
-int consume_cntrl_nxt(void) {
-	int res = is_cntrl(token->str);
-	if (res == 0) return 0;
-	next();
-	return res;
+	return tok_kind(token) == TK_IDENT;
 }
 
-int consume_cntrl(void) {
-	return is_cntrl(token->str);
-}
-
-int consume_d_type_nxt(void) {
-	int res = is_d_type(token->str);
-	if (res == 0) return 0;
-	next();
-	return res;
+static bool is_alnum(char c) {
+	return ('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z') || ('0' <= c && c <= '9') || (c == '_');
 }
 
-int consume_d_type(void) {
-	return is_d_type(token->str);
+/**
+ * @brief p[0, len)がキーワードならその種類、そうでなければTK_IDENTを返す
+ * 
+ */
+static TokenKind keyword_kind(char *p, int len) {
+	if (len < 2 || len > 6) return TK_IDENT;
+	const Keyword *kw = &keyword_table[((unsigned char)p[len - 1] + len) & 15];
+	if (kw->len == len && memcmp(p, kw->name, len) == 0) return kw->kind;
+	return TK_IDENT;
 }
 
-int get_cntrl_id(void) {
-	for (int i = 0; i < control_flow_size; i++) {
-		if (memcmp(token->str, control_flow[i], control_flow_len[i]) == 0) {
-			return i;
-		}
+/**
+ * @brief 記号を読む. 読めた長さを返し、*kindに種類を入れる. 記号でなければ0
+ * 
+ */
+static int read_punct(char *p, TokenKind *kind) {
+	// 2文字の記号の2文字目
+	char c = p + 1 < lex_end ? p[1] : '\0';
+	switch (*p)
+	{
+	case '+': *kind = TK_PLUS; return 1;
+	case '-': *kind = TK_MINUS; return 1;
+	case '*': *kind = TK_STAR; return 1;
+	case '/': *kind = TK_SLASH; return 1;
+	case '&': *kind = TK_AMP; return 1;
+	case '(': *kind = TK_LPAREN; return 1;
+	case ')': *kind = TK_RPAREN; return 1;
+	case '{': *kind = TK_LBRACE; return 1;
+	case '}': *kind = TK_RBRACE; return 1;
+	case '[': *kind = TK_LBRACKET; return 1;
+	case ']': *kind = TK_RBRACKET; return 1;
+	case ';': *kind = TK_SEMI; return 1;
+	case ',': *kind = TK_COMMA; return 1;
+	case '=':
+		if (c == '=') { *kind = TK_EQ; return 2; }
+		*kind = TK_ASSIGN;
+		return 1;
+	case '!':
+		if (c == '=') { *kind = TK_NE; return 2; }
+		return 0;
+	case '<':
+		if (c == '=') { *kind = TK_LE; return 2; }
+		*kind = TK_LT;
+		return 1;
+	case '>':
+		if (c == '=') { *kind = TK_GE; return 2; }
+		*kind = TK_GT;
+		return 1;
+	default:
+		return 0;
 	}
-	return -1;
 }
 
-int get_d_type_id(void) {
-	for (int i = 0; i < data_type_size; i++) {
-		if (memcmp(token->str, data_type[i], data_type_len[i]) == 0) {
-			return i;
-		}
-	}
-	return -1;
+bool at_eof(void) {
+	return tok_kind(token) == TK_EOF;
 }
 
-static bool is_alnum(char c) {
-	return ('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z') || ('0' <= c && c <= '9') || (c == '_');
+static void new_token(TokenKind kind, char *str, int len, int val) {
+	int i = tokens.count++ & TOKEN_RING_MASK;
+	tokens.kind[i] = kind;
+	tokens.loc[i] = str - user_input;
+	tokens.len[i] = len;
+	tokens.val[i] = val;
 }
 
-static int is_multi_punct(char *p) {
-	for (int i = 0; i < multi_punct_size; i++) {
-		if (memcmp(p, multi_punct[i], multi_punct_len[i]) == 0) return multi_punct_len[i];
+/**
+ * @brief トークンを1つ読んでリングバッファに追加する
+ * 
+ */
+static void lex_one(void) {
+	// " "
+	char *p = skip_space(lex_pos, lex_end);
+	if (p == lex_end) {
+		// EOFを読み進めようとしたときのために何度でもTK_EOFを返す
+		new_token(TK_EOF, p, 0, 0);
+		lex_pos = p;
+		return;
 	}
-	return 0;
-}
-
-static int is_single_punct(char *p) {
-	if (memcmp(p, "_", 1) == 0) return 0;
-	if (ispunct(*p) != 0) return 1;
-	return 0;
-}
-
-int is_cntrl(char *p) {
-	for (int i = 0; i < control_flow_size; i++) {
-		if (memcmp(p, control_flow[i], control_flow_len[i]) == 0 &&
-			!is_alnum(p[control_flow_len[i]])
-		) {
-			return control_flow_len[i];
-		}
+	// punctuator
+	TokenKind kind;
+	int punct_len = read_punct(p, &kind);
+	if (punct_len) {
+		new_token(kind, p, punct_len, 0);
+		lex_pos = p + punct_len;
+		return;
 	}
-	return 0;
-}
-
-int is_d_type(char *p) {
-	for (int i = 0; i < data_type_size; i++) {
-		if (memcmp(p, data_type[i], data_type_len[i]) == 0 &&
-			!is_alnum(p[data_type_len[i]])
-		) {
-			return data_type_len[i];
+	// number
+	if ('0' <= *p && *p <= '9') {
+		char *q = scan_digits(p, lex_end);
+		// 数値はintで持つので、収まらない値はエラーにする
+		long val = 0;
+		for (char *d = p; d < q; d++) {
+			val = val * 10 + (*d - '0');
+			if (val > INT_MAX) error_at(p, "too large number\n");
 		}
+		new_token(TK_NUM, p, q - p, val);
+		lex_pos = q;
+		return;
 	}
-	return 0;
-}
-
-static int is_reserved(char *p) {
-	int res = is_cntrl(p);
-	if (res) return res;
-	res = is_d_type(p);
-	if (res) return res;
-	res = is_multi_punct(p);
-	if (res) return res;
-	res = is_single_punct(p);
-	if (res) return res;
-	return 0;
+	// keyword, function name or variable
+	if (is_alnum(*p)) {
+		int len = scan_ident(p, lex_end) - p;
+		kind = keyword_kind(p, len);
+		new_token(kind, p, len, kind == TK_IDENT ? intern(p, len) : 0);
+		lex_pos = p + len;
+		return;
+	}
+	error_at(p, "can't tokenize\n");
 }
 
-static bool is_sizeof(char *p) {
-	char *szof = "sizeof";
-	if (memcmp(p, szof, 6) == 0 && !is_alnum(p[6])) return true;
-	return false;
+/**
+ * @brief リングバッファの半分までトークンを補充する.
+ * 今のトークンより前の TOKEN_RING_SIZE / 2 個は上書きしない
+ * 
+ */
+static void lex_more(void) {
+	int limit = token + TOKEN_RING_SIZE / 2;
+	while (tokens.count < limit) {
+		lex_one();
+		if (tok_kind(tokens.count - 1) == TK_EOF) return;
+	}
 }
 
-bool at_eof(void) {
-	return token->kind == TK_EOF;
-}
-
-static Token *new_token(TokenKind kind, Token *cur, char *str, int len) {
-	Token *tok = calloc(1, sizeof(Token));
-	tok->kind = kind;
-	tok->str = str;
-	cur->next = tok;
-	tok->len = len;
-	return tok;
-}
-
-Token *tokenize(char *p) {
-	Token head;
-	head.next = NULL;
-	Token *cur = &head;
-	while (*p) {
-		// " "
-		if (isspace(*p)) {
-			p++;
-			continue;
-		}
-		// reserved word
-		int reserved_len = is_reserved(p);
-		if (reserved_len) {
-			cur = new_token(TK_RESERVED, cur, p, reserved_len);
-			cur->len = reserved_len;
-			p += reserved_len;
-			continue;
-		}
-		// number
-		if (isdigit(*p)) {
-			cur = new_token(TK_NUM, cur, p, -1);
-			cur->val = strtol(p, &p, 10);
-			continue;
-		}
-		// sizeof
-		if (is_sizeof(p)) {
-			cur = new_token(TK_SIZEOF, cur, p, 6);
-			p += 6;
-			continue;
-		}
-		// function name or variable
-		if (is_alnum(*p)) {
-			cur = new_token(TK_IDENT, cur, p, -1);
-			int idx = 0;
-			while (is_alnum(p[idx])) {
-				idx++;
-			}
-			cur->len = idx;
-			p += idx;
-			continue;
-		}
-		error_at(token->str, "can't tokenize\n");
-	}
-	new_token(TK_EOF, cur, p, 0);
-	return head.next;
+/**
+ * @brief [p, end)の字句解析を始める. トークンはnext()で必要になった分だけ読む
+ * 
+ * @param p 
+ * @param end 
+ */
+void tokenize(char *p, char *end) {
+	if (skip_space == NULL) scan_init(SCAN_AUTO);
+	lex_pos = p;
+	lex_end = end;
+	tokens.count = 0;
+	token = 0;
+	lex_more();
 }
@@ -11,14 +11,49 @@
 
 #include "SverigeCC.h"
 
-Type *new_type(TypeKind typekind, Type *ptr_to, int sz) {
-	Type *type = calloc(1, sizeof(Type));
+// 基本型はそれぞれ1つだけ. 派生型はpointer_to, array_ofで作る
+static Type int_type = {TP_INT, NULL, 8};
+static Type char_type = {TP_CHAR, NULL, 1};
+Type *ty_int = &int_type;
+Type *ty_char = &char_type;
+
+static Type *new_type(TypeKind typekind, Type *ptr_to, int sz) {
+	Type *type = arena_alloc(&type_arena, sizeof(Type));
 	type->ty = typekind;
 	type->ptr_to = ptr_to;
 	type->_sizeof = sz;
 	return type;
 }
 
+/**
+ * @brief baseへのポインタ型を返す. 同じbaseには常に同じ型を返すので、型の比較はポインタの比較でよい
+ * 
+ * @param base 
+ * @return Type* 
+ */
+Type *pointer_to(Type *base) {
+	if (base->pointer == NULL) base->pointer = new_type(TP_PTR, base, 8);
+	return base->pointer;
+}
+
+/**
+ * @brief 要素数nのbaseの配列型を返す. 同じ(base, n)には常に同じ型を返す
+ * 
+ * @param base 
+ * @param n 
+ * @return Type* 
+ */
+Type *array_of(Type *base, int n) {
+	for (Type *now = base->arrays; now; now = now->next_array) {
+		if (now->array_size == n) return now;
+	}
+	Type *type = new_type(TP_ARRAY, base, n * base->_sizeof);
+	type->array_size = n;
+	type->next_array = base->arrays;
+	base->arrays = type;
+	return type;
+}
+
 bool is_int(Type *type) {
 	return type->ty == TP_INT || type->ty == TP_CHAR;
 }
@@ -35,19 +70,72 @@ bool is_char(Type *type) {
 	return type->ty == TP_CHAR;
 }
 
-void type_analyzer(Node *node) {
+// 型付けの途中のノードを積む明示的なスタック. 深い式や長い文の並びでもCのスタックを使わない
+typedef struct {
+	Node *node;
+	// 子ノードを積み終わっていて、あとは自分の型を決めるだけ
+	bool expanded;
+} TypeFrame;
+
+static TypeFrame *frames;
+static int frame_len;
+static int frame_cap;
+
+static void push_frame(Node *node, bool expanded) {
 	if (node == NULL) return;
-	type_analyzer(node->lhs);
-	type_analyzer(node->rhs);
-	type_analyzer(node->condition);
-	type_analyzer(node->then_stmt);
-	type_analyzer(node->else_stmt);
-	type_analyzer(node->init);
-	type_analyzer(node->loop);
-	type_analyzer(node->next_arg);
-	type_analyzer(node->next_stmt);
-	type_analyzer(node->next);
+	if (frame_len == frame_cap) {
+		frame_cap = frame_cap ? frame_cap * 2 : 256;
+		frames = realloc(frames, frame_cap * sizeof(TypeFrame));
+		if (frames == NULL) error("out of memory (type_analyzer)\n");
+	}
+	frames[frame_len].node = node;
+	frames[frame_len].expanded = expanded;
+	frame_len++;
+}
 
+/**
+ * @brief 子ノードをkindごとに積む. 型は子どうしの順番に依存しないので順不同でよい
+ * 
+ * @param node 
+ */
+static void push_children(Node *node) {
+	switch (node->kind)
+	{
+	case ND_NUM:
+	case ND_LVAR:
+	case ND_GVAR:
+	case ND_ARG:
+	case ND_NULL:
+		break;
+	case ND_IF:
+	case ND_FOR:
+		push_frame(node->condition, false);
+		push_frame(node->then_stmt, false);
+		if (node->kind == ND_IF) push_frame(node->else_stmt, false);
+		else {
+			push_frame(node->init, false);
+			push_frame(node->loop, false);
+		}
+		break;
+	case ND_BLOCK:
+		for (Node *now = node->body; now; now = now->next) push_frame(now, false);
+		break;
+	case ND_FUNCALL:
+		for (Node *now = node->args; now; now = now->next) push_frame(now, false);
+		break;
+	default:
+		push_frame(node->lhs, false);
+		push_frame(node->rhs, false);
+		break;
+	}
+}
+
+/**
+ * @brief 子ノードの型が決まっているnodeの型を決める
+ * 
+ * @param node 
+ */
+static void set_type(Node *node) {
 	switch (node->kind)
 	{
 	case ND_ADD:
@@ -63,9 +151,7 @@ void type_analyzer(Node *node) {
 	case ND_FUNCALL:
 	case ND_PTR_DIFF:
 	case ND_NUM:
-		node->type = calloc(1, sizeof(Type));
-		node->type->ty = TP_INT;
-		node->type->_sizeof = 8;
+		node->type = ty_int;
 		return;
 	case ND_ASSIGN:
 	case ND_PTR_ADD:
@@ -73,10 +159,7 @@ void type_analyzer(Node *node) {
 		node->type = node->lhs->type;
 		return;
 	case ND_ADDR:
-		node->type = calloc(1, sizeof(Type));
-		node->type->ty = TP_PTR;
-		node->type->ptr_to = node->lhs->type;
-		node->type->_sizeof = 8;
+		node->type = pointer_to(node->lhs->type);
 		return;
 	case ND_DEREF:
 		node->type = node->lhs->type->ptr_to;
@@ -84,4 +167,26 @@ void type_analyzer(Node *node) {
 	default:
 		break;
 	}
-}
\ No newline at end of file
+}
+
+/**
+ * @brief nodeとその子の型を決める. 一度型を決めた部分木には二度と入らないので、
+ * 構文解析中に何度呼んでも全体で各ノードを1回ずつしか見ない
+ * 
+ * @param node 
+ */
+void type_analyzer(Node *node) {
+	int base = frame_len;
+	push_frame(node, false);
+	while (frame_len > base) {
+		TypeFrame frame = frames[--frame_len];
+		if (frame.expanded) {
+			set_type(frame.node);
+			continue;
+		}
+		if (frame.node->typed) continue;
+		frame.node->typed = true;
+		push_frame(frame.node, true);
+		push_children(frame.node);
+	}
+}
@@ -21,9 +21,18 @@
 void error_at(char *loc, char *fmt, ...) {
 	va_list ap;
 	va_start(ap, fmt);
-	int pos = loc - user_input;
-	fprintf(stderr, "%s\n", user_input);
-	fprintf(stderr, "%*s", pos, " ");
+	// locを含む行だけを表示する
+	char *line = loc;
+	while (user_input < line && line[-1] != '\n') line--;
+	char *end = loc;
+	while (end < user_input_end && *end != '\n') end++;
+	int line_no = 1;
+	for (char *p = user_input; p < line; p++) {
+		if (*p == '\n') line_no++;
+	}
+	int indent = fprintf(stderr, "%s:%d: ", input_path, line_no);
+	fprintf(stderr, "%.*s\n", (int)(end - line), line);
+	fprintf(stderr, "%*s", indent + (int)(loc - line), "");
 	fprintf(stderr, "^ ");
 	vfprintf(stderr, fmt, ap);
 	fprintf(stderr, "\n");